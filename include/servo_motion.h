@@ -0,0 +1,201 @@
+#ifndef SERVO_MOTION_H
+#define SERVO_MOTION_H
+
+/*
+ * Fixed-point motion core shared by servo.c and the userspace tools
+ * (tools/servosim.c). Header-only and freestanding: no state, no locking,
+ * no allocation, only __s64/__u64 integer math, so the same code runs in
+ * the motion tick and in offline simulation.
+ *
+ * Units: angles in millidegrees (mdeg), speeds in degrees/s (dps) or
+ * millidegrees/s (mdps), times in ns/us/ms as named.
+ */
+
+#include "servo_uapi.h"
+
+#ifdef __KERNEL__
+#include <linux/math64.h>
+#define servo_div64_s64(a, b)       div64_s64(a, b)
+#define servo_mul_div_u64(a, b, c)  mul_u64_u64_div_u64(a, b, c)
+#else
+static inline __s64 servo_div64_s64(__s64 a, __s64 b)
+{
+    return a / b;
+}
+
+#ifdef __SIZEOF_INT128__
+static inline __u64 servo_mul_div_u64(__u64 a, __u64 b, __u64 c)
+{
+    return (__u64)((unsigned __int128)a * b / c);
+}
+#else
+/* No 128-bit type (32-bit hosts): 128-bit product, shift-subtract divide */
+static inline __u64 servo_mul_div_u64(__u64 a, __u64 b, __u64 c)
+{
+    __u64 al = a & 0xffffffffu, ah = a >> 32, bl = b & 0xffffffffu, bh = b >> 32;
+    __u64 ll = al * bl, lh = al * bh, hl = ah * bl;
+    __u64 mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+    __u64 hi = ah * bh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    __u64 lo = (mid << 32) | (ll & 0xffffffffu);
+    __u64 q = 0, r = 0, top;
+    int i;
+
+    /* the quotient fits 64 bits for every caller, like the kernel helper */
+    for (i = 127; i >= 0; i--) {
+        top = r >> 63;
+        r = (r << 1) | ((i >= 64 ? hi >> (i - 64) : lo >> i) & 1);
+        q <<= 1;
+        if (top || r >= c) {
+            r -= c;
+            q |= 1;
+        }
+    }
+    return q;
+}
+#endif
+#endif
+
+/* Angle -> pulse width, clamped to the limits (max > min on both axes) */
+static inline unsigned int servo_core_pulse_ns(const struct servo_limits *l, __s64 mdeg)
+{
+    __s64 lo = (__s64)l->min_angle * 1000;
+    __s64 hi = (__s64)l->max_angle * 1000;
+
+    if (mdeg < lo) mdeg = lo;
+    if (mdeg > hi) mdeg = hi;
+
+    /* 64x64/64: span * angle overflows 32 bits for wide ranges */
+    return l->min_pulse_ns +
+           (unsigned int)servo_mul_div_u64(l->max_pulse_ns - l->min_pulse_ns,
+                                           mdeg - lo, hi - lo);
+}
+
+/* Pulse width -> angle, the inverse of servo_core_pulse_ns() */
+static inline int servo_core_pulse_mdeg(const struct servo_limits *l, unsigned int pulse_ns)
+{
+    __s64 lo = (__s64)l->min_angle * 1000;
+    __s64 hi = (__s64)l->max_angle * 1000;
+
+    if (pulse_ns < l->min_pulse_ns) pulse_ns = l->min_pulse_ns;
+    if (pulse_ns > l->max_pulse_ns) pulse_ns = l->max_pulse_ns;
+
+    /* same domain as the forward map: non-negative operands after clamping */
+    return (int)(lo + (__s64)servo_mul_div_u64(pulse_ns - l->min_pulse_ns, hi - lo,
+                                               l->max_pulse_ns - l->min_pulse_ns));
+}
+
+/*
+ * Continuous rotation: velocity in permille of full speed (-1000..1000) ->
+ * pulse width. 0 gives neutral_ns (0: middle of the pulse limits); any
+ * other velocity starts past the deadband, so small commands still turn
+ * the servo. Clamped to the pulse limits.
+ */
+static inline unsigned int servo_core_vel_pulse_ns(const struct servo_limits *l,
+                                                   unsigned int neutral_ns,
+                                                   unsigned int deadband_ns, int vel)
+{
+    __s64 lo = l->min_pulse_ns, hi = l->max_pulse_ns, n, p;
+
+    n = neutral_ns ? neutral_ns : lo + (hi - lo) / 2;
+    if (vel > 0)
+        p = n + deadband_ns + servo_div64_s64((hi - n - deadband_ns) * vel, 1000);
+    else if (vel < 0)
+        p = n - deadband_ns + servo_div64_s64((n - deadband_ns - lo) * vel, 1000);
+    else
+        p = n;
+
+    if (p < lo) p = lo;
+    if (p > hi) p = hi;
+    return (unsigned int)p;
+}
+
+/* Whole degrees per tick for speed_dps, rounded, at least 1 */
+static inline int servo_core_step_deg_us(int speed_dps, unsigned int tick_us)
+{
+    __s64 step = servo_div64_s64((__s64)speed_dps * tick_us + 500000, 1000000);
+
+    return step > 0 ? (int)step : 1;
+}
+
+static inline int servo_core_step_deg(int speed_dps, unsigned int tick_ms)
+{
+    return servo_core_step_deg_us(speed_dps, tick_ms * 1000);
+}
+
+/* One speed-limited step from cur towards target, never past it */
+static inline int servo_core_step(int cur, int target, int step_deg)
+{
+    if (target > cur)
+        return target - cur > step_deg ? cur + step_deg : target;
+    return cur - target > step_deg ? cur - step_deg : target;
+}
+
+/*
+ * Tangent at k in mdeg/s: the knot's own velocity with SERVO_KNOT_VEL,
+ * else the Catmull-Rom chord slope between prev and next. Knots without a
+ * neighbour (NULL) start/stop at rest.
+ */
+static inline __s64 servo_core_tangent(const struct servo_knot *prev,
+                                       const struct servo_knot *k,
+                                       const struct servo_knot *next)
+{
+    if (k->flags & SERVO_KNOT_VEL)
+        return k->vel_mdps;
+    if (!prev || !next)
+        return 0;
+    return servo_div64_s64(((__s64)next->angle_mdeg - prev->angle_mdeg) * 1000,
+                           (__s64)next->t_ms - prev->t_ms);
+}
+
+/*
+ * Cubic Hermite segment k0 -> k1 at t_us (same time base as t_ms), Q16:
+ *   p(u) = h00 p0 + h10 T m0 + h01 p1 + h11 T m1,  u = (t - t0) / T
+ */
+static inline int servo_core_hermite(const struct servo_knot *k0,
+                                     const struct servo_knot *k1,
+                                     __s64 m0, __s64 m1, __s64 t_us)
+{
+    const __s64 tm_max = 1LL << 40;  /* keeps h * tm inside 64 bits */
+    __s64 seg_ms = (__s64)k1->t_ms - k0->t_ms;
+    __s64 u, u2, u3, h00, h10, h01, h11, tm0, tm1;
+
+    u  = servo_div64_s64((t_us - (__s64)k0->t_ms * 1000) * 65536, seg_ms * 1000);
+    u2 = (u * u) >> 16;
+    u3 = (u2 * u) >> 16;
+
+    h00 = 2 * u3 - 3 * u2 + 65536;
+    h10 = u3 - 2 * u2 + u;
+    h01 = -2 * u3 + 3 * u2;
+    h11 = u3 - u2;
+
+    /* tangent * segment length in millidegrees */
+    tm0 = servo_div64_s64(m0 * seg_ms, 1000);
+    tm1 = servo_div64_s64(m1 * seg_ms, 1000);
+    if (tm0 > tm_max) tm0 = tm_max;
+    if (tm0 < -tm_max) tm0 = -tm_max;
+    if (tm1 > tm_max) tm1 = tm_max;
+    if (tm1 < -tm_max) tm1 = -tm_max;
+
+    return (int)((h00 * k0->angle_mdeg + h10 * tm0 +
+                  h01 * k1->angle_mdeg + h11 * tm1) >> 16);
+}
+
+/*
+ * Streaming segment from -> to over dur_ns, el_ns after it started:
+ * linear inside the segment, extrapolated with the same velocity for up
+ * to horizon_ns past its end. Sets *held once the horizon is used up.
+ */
+static inline __s64 servo_core_stream_pos(int from, int to, __s64 dur_ns,
+                                          __s64 horizon_ns, __s64 el_ns, int *held)
+{
+    *held = 0;
+    if (el_ns < 0)
+        el_ns = 0;
+    if (el_ns >= dur_ns + horizon_ns) {
+        el_ns = dur_ns + horizon_ns;
+        *held = 1;
+    }
+    return from + servo_div64_s64((__s64)(to - from) * el_ns, dur_ns);
+}
+
+#endif /* SERVO_MOTION_H */
@@ -2,6 +2,7 @@
 #define SERVO_UAPI_H
 
 #include <linux/ioctl.h>
+#include <linux/types.h>
 
 #define SERVO_IOC_MAGIC   's'
 
@@ -25,4 +26,269 @@ struct servo_limits {
 #define SERVO_IOCTL_GET_LIMITS    _IOR(SERVO_IOC_MAGIC, 0x06, struct servo_limits)
 #define SERVO_IOCTL_ENABLE        _IOW(SERVO_IOC_MAGIC, 0x07, int) /* 0/1 */
 
+/* Emergency stop: PWM output off without waiting for the motion loop.
+ * The servo stays disabled until SERVO_IOCTL_ENABLE with 1.
+ * ESTOP_ALL stops every servo of the controller. */
+#define SERVO_IOCTL_ESTOP         _IO(SERVO_IOC_MAGIC, 0x08)
+#define SERVO_IOCTL_ESTOP_ALL     _IO(SERVO_IOC_MAGIC, 0x09)
+
+/* Scheduled command: applied on the first motion tick at or after
+ * deadline_ns (absolute CLOCK_MONOTONIC). value is the angle for
+ * SET_ANGLE_AT and 0/1 for ENABLE_AT. -ENOSPC if the queue is full. */
+struct servo_timed {
+    __s64 deadline_ns;
+    int   value;
+    int   reserved;         /* 0 */
+};
+
+#define SERVO_IOCTL_SET_ANGLE_AT  _IOW(SERVO_IOC_MAGIC, 0x0a, struct servo_timed)
+#define SERVO_IOCTL_ENABLE_AT     _IOW(SERVO_IOC_MAGIC, 0x0b, struct servo_timed)
+
+/* Trajectory knot. t_ms is relative to the trajectory start and must be
+ * strictly increasing. The motion engine evaluates a cubic Hermite spline
+ * between knots; with SERVO_KNOT_VEL vel_mdps is the tangent, otherwise a
+ * Catmull-Rom tangent is derived from the neighbouring knots (0 at the
+ * first and last knot). A streaming client should stay one knot ahead. */
+struct servo_knot {
+    __u32 t_ms;
+    __s32 angle_mdeg;       /* millidegrees */
+    __s32 vel_mdps;         /* millidegrees/s, with SERVO_KNOT_VEL */
+    __u32 flags;            /* SERVO_KNOT_* */
+};
+
+#define SERVO_KNOT_VEL      (1U << 0)
+
+struct servo_traj {
+    __u64 knots;            /* user pointer to struct servo_knot[count] */
+    __u32 count;
+    __u32 flags;            /* SERVO_TRAJ_* */
+    __s64 start_ns;         /* CLOCK_MONOTONIC, 0 = now; ignored on APPEND */
+};
+
+#define SERVO_TRAJ_APPEND   (1U << 0)   /* extend the loaded trajectory */
+
+/* A new SET_ANGLE/SET_ANGLE_AT or TRAJ_STOP ends the trajectory. */
+#define SERVO_IOCTL_TRAJ_LOAD     _IOW(SERVO_IOC_MAGIC, 0x0c, struct servo_traj)
+#define SERVO_IOCTL_TRAJ_STOP     _IO(SERVO_IOC_MAGIC, 0x0d)
+
+/* Streaming mode for producers slower than the control tick: every
+ * SET_ANGLE starts a linear segment from the current output to the new
+ * setpoint, spread over the measured stream interval (speed is ignored).
+ * If the stream stalls, the last velocity is extrapolated for at most
+ * horizon_ms (0..1000), then the servo holds. */
+struct servo_stream {
+    __u32 enable;           /* 0/1 */
+    __u32 horizon_ms;
+};
+
+#define SERVO_IOCTL_SET_STREAM    _IOW(SERVO_IOC_MAGIC, 0x0e, struct servo_stream)
+
+/* Submission ring, mmap()ed from the device at offset 0 (SERVO_RING_SIZE
+ * bytes, one ring per servo, one producer). The producer fills
+ * entries[tail % SERVO_RING_ENTRIES] and publishes tail with a release
+ * store; the motion tick consumes everything up to tail and advances head.
+ * The driver sets SERVO_RING_NEED_WAKEUP in flags once its loop went idle:
+ * after publishing, the producer issues a full barrier, checks flags and
+ * only then needs SERVO_IOCTL_RING_KICK. */
+struct servo_ring_entry {
+    __u32 op;               /* SERVO_RING_OP_* */
+    __s32 value;            /* degrees (ANGLE), deg/s (SPEED) */
+};
+
+#define SERVO_RING_OP_ANGLE     1   /* as SET_ANGLE */
+#define SERVO_RING_OP_SPEED     2   /* as SET_SPEED */
+#define SERVO_RING_OP_PULSE     3   /* as SET_PULSE_NS */
+
+#define SERVO_RING_ENTRIES      512 /* power of two */
+#define SERVO_RING_NEED_WAKEUP  (1U << 0)
+
+struct servo_ring {
+    __u32 head;             /* written by the driver */
+    __u32 tail;             /* written by userspace */
+    __u32 flags;            /* SERVO_RING_*, written by the driver */
+    __u32 reserved[13];     /* head/tail/flags in their own cache line */
+    struct servo_ring_entry entries[SERVO_RING_ENTRIES];
+};
+
+#define SERVO_RING_SIZE         sizeof(struct servo_ring)
+
+#define SERVO_IOCTL_RING_KICK     _IO(SERVO_IOC_MAGIC, 0x0f)
+
+/* Event notification through an eventfd. On /dev/servoN per servo, flags
+ * 0. On /dev/servo-ctl with SERVO_EVENTFD_CONTROLLER one eventfd for all
+ * servos of the driver, which then reads the servos with pending events
+ * from GET_PENDING (bit n = /dev/servoN). fd -1 unregisters. GET_EVENTS
+ * reads and clears the SERVO_EV_* bits pending on this servo. */
+struct servo_eventfd {
+    __s32 fd;
+    __u32 mask;             /* SERVO_EV_* that signal the eventfd */
+    __u32 flags;            /* SERVO_EVENTFD_* */
+    __u32 reserved;         /* 0 */
+};
+
+#define SERVO_EV_TARGET_REACHED  (1U << 0)  /* motion ended at the target */
+#define SERVO_EV_TRAJ_UNDERRUN   (1U << 1)  /* trajectory ran out of knots */
+#define SERVO_EV_PWM_FAULT       (1U << 2)  /* PWM apply failed */
+#define SERVO_EV_ALL             0x7U
+
+#define SERVO_EVENTFD_CONTROLLER (1U << 0)
+
+#define SERVO_PENDING_WORDS      4          /* 256 servos */
+
+struct servo_pending {
+    __u64 ids[SERVO_PENDING_WORDS];
+};
+
+#define SERVO_IOCTL_SET_EVENTFD   _IOW(SERVO_IOC_MAGIC, 0x10, struct servo_eventfd)
+#define SERVO_IOCTL_GET_EVENTS    _IOR(SERVO_IOC_MAGIC, 0x11, __u32)
+#define SERVO_IOCTL_GET_PENDING   _IOR(SERVO_IOC_MAGIC, 0x12, struct servo_pending)
+
+/* Consistent snapshot of one servo, taken under its lock */
+struct servo_state {
+    __s64 stamp_ns;         /* CLOCK_MONOTONIC of the snapshot */
+    __u32 index;            /* N of /dev/servoN */
+    __u32 flags;            /* SERVO_STATE_* */
+    __s32 cur_angle;
+    __s32 target_angle;
+    __s32 cur_mdeg;
+    __s32 speed_dps;
+    struct servo_limits limits;
+    __u32 pulse_ns;         /* last applied duty */
+    __u32 timed_depth;      /* pending SET_ANGLE_AT/ENABLE_AT */
+    __u32 traj_depth;       /* trajectory knots still loaded */
+    __u32 ring_depth;       /* unconsumed ring entries */
+    __s32 velocity;         /* velocity mode: current, permille */
+    __s32 target_velocity;  /* velocity mode: commanded, permille */
+    __u32 reserved[2];      /* 0 */
+};
+
+#define SERVO_STATE_ENABLED      (1U << 0)
+#define SERVO_STATE_MOVING       (1U << 1)
+#define SERVO_STATE_ESTOP        (1U << 2)
+#define SERVO_STATE_TRAJ         (1U << 3)  /* trajectory playing */
+#define SERVO_STATE_STREAM       (1U << 4)  /* streaming mode on */
+#define SERVO_STATE_RAW          (1U << 5)  /* raw pulse mode */
+#define SERVO_STATE_VELOCITY     (1U << 6)  /* continuous rotation */
+
+#define SERVO_IOCTL_GET_STATE     _IOR(SERVO_IOC_MAGIC, 0x13, struct servo_state)
+
+/* Controller node /dev/servo-ctl: requests across all servos. GET_STATES
+ * fills states[0..count) with one snapshot per servo and returns the
+ * number filled in count; total is the number of servos. The controller
+ * node also accepts SET_EVENTFD (controller eventfd), ESTOP_ALL,
+ * GET_PENDING, COMMIT and STAGE_BATCH. */
+struct servo_states {
+    __u64 states;           /* user pointer to struct servo_state[count] */
+    __u32 count;            /* in: capacity, out: filled */
+    __u32 total;            /* out */
+};
+
+#define SERVO_CTL_NAME            "servo-ctl"
+
+#define SERVO_IOCTL_GET_STATES    _IOWR(SERVO_IOC_MAGIC, 0x14, struct servo_states)
+
+/* Two-phase update. STAGE records changes on a servo without touching its
+ * output; a later STAGE of the same field replaces the earlier one and an
+ * empty mask drops everything staged on the servo. COMMIT, on any servo
+ * node or on /dev/servo-ctl, releases what is staged on all servos at
+ * once: every servo applies it on its next control tick, and a STAGE is
+ * either entirely in a commit or entirely in the next. */
+struct servo_stage {
+    __u32 mask;             /* SERVO_STAGE_* fields to stage */
+    __u32 index;            /* N of /dev/servoN, STAGE_BATCH only */
+    __s32 angle;
+    __s32 speed_dps;
+    struct servo_limits limits;
+    __u32 pulse_ns;
+    __u32 reserved;         /* 0 */
+};
+
+#define SERVO_STAGE_ANGLE        (1U << 0)
+#define SERVO_STAGE_SPEED        (1U << 1)
+#define SERVO_STAGE_LIMITS       (1U << 2)
+#define SERVO_STAGE_PULSE        (1U << 3)  /* as SET_PULSE_NS, not with ANGLE */
+#define SERVO_STAGE_ALL          0xfU
+
+/* STAGE for several servos in one call on /dev/servo-ctl. Nothing is
+ * staged unless all entries are valid; SERVO_BATCH_COMMIT commits right
+ * after. */
+struct servo_stage_batch {
+    __u64 stages;           /* user pointer to struct servo_stage[count] */
+    __u32 count;            /* 1..256 */
+    __u32 flags;            /* SERVO_BATCH_* */
+};
+
+#define SERVO_BATCH_COMMIT       (1U << 0)
+
+#define SERVO_IOCTL_STAGE         _IOW(SERVO_IOC_MAGIC, 0x15, struct servo_stage)
+#define SERVO_IOCTL_COMMIT        _IO(SERVO_IOC_MAGIC, 0x16)
+#define SERVO_IOCTL_STAGE_BATCH   _IOW(SERVO_IOC_MAGIC, 0x17, struct servo_stage_batch)
+
+/* Raw pulse mode for controllers that compute the pulse width themselves:
+ * SET_PULSE_NS drives the output with exactly that width, clamped to
+ * min_pulse_ns..max_pulse_ns, without the angle mapping or the speed limit
+ * (with streaming on it becomes a stream setpoint in ns). Any angle
+ * setpoint returns to angle mode. GET_PULSE_NS reads the width last
+ * applied, in either mode. */
+#define SERVO_IOCTL_SET_PULSE_NS  _IOW(SERVO_IOC_MAGIC, 0x18, __u32)
+#define SERVO_IOCTL_GET_PULSE_NS  _IOR(SERVO_IOC_MAGIC, 0x19, __u32)
+
+/* Continuous-rotation servos, where the pulse sets a speed, not a position.
+ * In SERVO_MODE_VELOCITY the motion loop ramps the output towards the
+ * SET_VELOCITY command (permille of full speed, -1000..1000, sign =
+ * direction) at ramp_pmps permille per second; position commands
+ * (SET_ANGLE, SET_ANGLE_AT, TRAJ_LOAD, SET_PULSE_NS) fail with EBUSY, and
+ * SET_VELOCITY does outside velocity mode. Also set from DT, see servo.c. */
+struct servo_rotation {
+    __u32 mode;             /* SERVO_MODE_* */
+    __u32 neutral_ns;       /* pulse at standstill, 0: middle of the pulse limits */
+    __u32 deadband_ns;      /* +- around neutral_ns where the servo stands still */
+    __u32 ramp_pmps;        /* max velocity change in permille/s, 0 = none */
+};
+
+#define SERVO_MODE_POSITION      0
+#define SERVO_MODE_VELOCITY      1
+
+#define SERVO_VELOCITY_MAX       1000
+
+#define SERVO_IOCTL_SET_ROTATION  _IOW(SERVO_IOC_MAGIC, 0x1a, struct servo_rotation)
+#define SERVO_IOCTL_GET_ROTATION  _IOR(SERVO_IOC_MAGIC, 0x1b, struct servo_rotation)
+#define SERVO_IOCTL_SET_VELOCITY  _IOW(SERVO_IOC_MAGIC, 0x1c, __s32)
+#define SERVO_IOCTL_GET_VELOCITY  _IOR(SERVO_IOC_MAGIC, 0x1d, __s32)
+
+/* Output protocol and frame period. STANDARD is the 1..2 ms servo pulse,
+ * by default at 50 Hz; digital servos take a shorter period (e.g. 3003003
+ * ns for 333 Hz). The ESC short-pulse protocols run their own pulse range
+ * at a period tightened to the longest pulse, so a new duty reaches the
+ * actuator within a fraction of a millisecond. Switching the protocol
+ * resets the pulse limits to its range and the velocity-mode neutral and
+ * deadband to their defaults. */
+struct servo_protocol {
+    __u32 protocol;         /* SERVO_PROTO_* */
+    __u32 period_ns;        /* 0: the protocol's default, > max_pulse_ns */
+};
+
+#define SERVO_PROTO_STANDARD     0  /* 1000..2000 us, 20 ms */
+#define SERVO_PROTO_ONESHOT125   1  /* 125..250 us, 312.5 us */
+#define SERVO_PROTO_ONESHOT42    2  /* 41.7..83.3 us, 104.2 us */
+#define SERVO_PROTO_MULTISHOT    3  /* 5..25 us, 31.25 us */
+
+#define SERVO_IOCTL_SET_PROTOCOL  _IOW(SERVO_IOC_MAGIC, 0x1e, struct servo_protocol)
+#define SERVO_IOCTL_GET_PROTOCOL  _IOR(SERVO_IOC_MAGIC, 0x1f, struct servo_protocol)
+
+/* Frame period and control tick of one servo, 0 keeps a value. The PWM is
+ * programmed with a new period right away, also while disabled, so a
+ * period the chip cannot do fails here. The motion loop runs every tick_us
+ * rounded to whole frames, which GET_TIMING reports in tick_ns; e.g. a
+ * 333 Hz digital servo with tick_us 3003 gets one update per frame. */
+struct servo_timing {
+    __u32 period_ns;        /* see SET_PROTOCOL */
+    __u32 tick_us;          /* 500..1000000 */
+    __u32 tick_ns;          /* GET_TIMING: tick in effect */
+    __u32 reserved;         /* 0 */
+};
+
+#define SERVO_IOCTL_SET_TIMING    _IOW(SERVO_IOC_MAGIC, 0x20, struct servo_timing)
+#define SERVO_IOCTL_GET_TIMING    _IOR(SERVO_IOC_MAGIC, 0x21, struct servo_timing)
+
 #endif /* SERVO_UAPI_H */
@@ -9,158 +9,1560 @@
 #include <linux/pwm.h>
 #include <linux/mutex.h>
 #include <linux/workqueue.h>
+#include <linux/list.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/idr.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/eventfd.h>
+#include <linux/bitmap.h>
+#include <linux/spinlock.h>
+#include <linux/miscdevice.h>
+#include <kunit/static_stub.h>
 
 #include "servo_uapi.h"
+#include "servo_motion.h"
 
-#define SERVO_DEVICE_NAME  "servo0"
+#define CREATE_TRACE_POINTS
+#include "servo_trace.h"
+
+#define SERVO_DEVICE_NAME  "servo%d"
 #define SERVO_CLASS_NAME   "servo_class"
+#define SERVO_MAX_DEVICES  256
 
 #define SERVO_DEFAULT_PERIOD_NS  20000000U   /* 20 ms -> 50 Hz */
 #define SERVO_DEFAULT_MIN_NS      1000000U   /* 1.0 ms */
 #define SERVO_DEFAULT_MAX_NS      2000000U   /* 2.0 ms */
+#define SERVO_MAX_PERIOD_NS     100000000U   /* 100 ms -> 10 Hz */
+#define SERVO_MIN_TICK_US             500U   /* 2 kHz */
+#define SERVO_MAX_TICK_US         1000000U
+
+#define SERVO_TIMED_DEPTH        16  /* pending SET_ANGLE_AT/ENABLE_AT */
+#define SERVO_TRAJ_MAX_KNOTS     1024 /* trajectory ring capacity */
+#define SERVO_TRAJ_MAX_VEL_MDPS  100000000 /* 100000 deg/s */
+#define SERVO_STREAM_MAX_NS      1000000000LL /* longest interval/horizon */
+#define SERVO_RING_IDLE_TICKS    50  /* ticks the loop keeps polling an idle ring */
+#define SERVO_VEL_MAX_RAMP       1000000 /* permille/s, full reversal in 2 ms */
+
+/* sd->flags */
+#define SERVO_F_LOOP             0   /* motion work queued or running */
+#define SERVO_F_ESTOP            1   /* emergency stop latched */
+#define SERVO_F_DEAD             2   /* being removed, the tick does not re-arm */
+
+enum servo_timed_op {
+    SERVO_TIMED_ANGLE,
+    SERVO_TIMED_ENABLE,
+};
+
+struct servo_timed_cmd {
+    ktime_t              deadline;
+    enum servo_timed_op  op;
+    int                  value;
+};
 
 struct servo_dev {
     struct device       *dev;
     struct pwm_device   *pwm;
-    unsigned int         period_ns;
+    unsigned int         period_ns;      /* frame period (lock) */
+    unsigned int         protocol;       /* SERVO_PROTO_* (lock) */
 
     struct mutex         lock;
+    struct mutex         pwm_lock;       /* serializes PWM calls, nests in lock */
+    struct list_head     node;           /* servo_list */
 
     /* Char device */
+    int                  id;             /* minor, N of /dev/servoN */
+    char                 name[16];
     dev_t                devt;
     struct cdev          cdev;
-    struct class        *cls;
     struct device       *cdev_dev;
 
     /* State */
     int                  enabled;        /* 0/1 */
     int                  cur_angle;      /* 0..180 (gerundet) */
+    int                  cur_mdeg;       /* exact position, millidegrees */
+    unsigned int         duty_ns;        /* last applied pulse */
     int                  target_angle;   /* 0..180 */
     int                  speed_dps;      /* degrees per second; 0 = jump */
+    unsigned int         raw_pulse_ns;   /* raw pulse mode target; 0 = angle mode */
 
     struct servo_limits  limits;
 
+    /* Continuous rotation: velocity in permille of full speed (lock) */
+    bool                 vel_mode;       /* also read by position ioctls */
+    int                  vel_target;
+    int                  vel_cur;
+    unsigned int         vel_neutral_ns; /* 0: middle of the pulse limits */
+    unsigned int         vel_deadband_ns;
+    unsigned int         vel_ramp;       /* permille per second; 0 = jump */
+
+    /* Setpoint mailbox: SET_ANGLE publishes lock-free, the tick consumes */
+    atomic_t             sp_angle;       /* latest requested angle */
+    atomic_t             sp_seq;         /* bumped on every publish */
+    atomic64_t           sp_stamp;       /* publish time, streaming only */
+    unsigned int         sp_seen;        /* last sp_seq consumed (lock) */
+    unsigned long        flags;          /* SERVO_F_* */
+
     /* Motion */
     struct delayed_work  motion_work;
-    unsigned int         tick_ms;        /* control loop period (e.g. 20 ms) */
+    unsigned int         tick_us;        /* control loop period as set (e.g. 20 ms) */
+    ktime_t              tick_due;       /* when the re-queued tick should run, 0 after a kick */
+    struct hrtimer       tick_timer;     /* queues motion_work at tick_due */
+    ktime_t              frame_t0;       /* a PWM frame boundary: enable or period change */
+
+    /* Scheduled commands, sorted by deadline (lock) */
+    struct servo_timed_cmd timed[SERVO_TIMED_DEPTH];
+    unsigned int         timed_count;
+    struct hrtimer       timed_timer;    /* fires at timed[0].deadline */
+
+    /* mmap submission ring (lock) */
+    struct servo_ring   *ring;           /* vmalloc_user, on first mmap */
+    u32                  ring_head;      /* ours; userspace may scribble on ring->head */
+    unsigned int         ring_idle;      /* ticks left before the loop may idle */
+
+    /* Spline trajectory: ring of knots, oldest still needed first (lock) */
+    struct servo_knot   *traj;           /* SERVO_TRAJ_MAX_KNOTS, lazily */
+    unsigned int         traj_head;
+    unsigned int         traj_count;
+    ktime_t              traj_start;
+    bool                 traj_active;
+
+    /* Setpoint streaming: segment stream_from -> stream_to (lock) */
+    bool                 stream_on;      /* also read by SET_ANGLE */
+    bool                 stream_moving;
+    s64                  stream_horizon_ns;
+    s64                  stream_dur_ns;  /* smoothed setpoint interval */
+    ktime_t              stream_t0;      /* arrival of stream_to */
+    bool                 stream_raw;     /* segment in ns of pulse, not mdeg */
+    int                  stream_from;    /* mdeg or ns */
+    int                  stream_to;      /* mdeg or ns */
+
+    /* Staged changes, due once servo_commit_gen moves past stage_gen (lock) */
+    struct servo_stage   stage;          /* mask 0: nothing staged */
+    u32                  stage_gen;
+
+    /* Event notification (lock) */
+    struct eventfd_ctx  *evfd;
+    u32                  ev_mask;
+    u32                  ev_pending;     /* SERVO_EV_*, until GET_EVENTS */
+
+    /* Stats (pwm_lock) */
+    struct dentry       *dbg;
+    u64                  estop_count;
+    u64                  estop_last_ns;  /* request -> PWM off */
+    u64                  estop_max_ns;
+};
+
+/* Pulse range and default frame period of the SERVO_PROTO_* */
+static const struct servo_proto {
+    const char          *name;           /* DT servo-protocol */
+    unsigned int         min_ns;
+    unsigned int         max_ns;
+    unsigned int         period_ns;      /* standard: 50 Hz, else max_ns * 5 / 4 */
+} servo_protos[] = {
+    [SERVO_PROTO_STANDARD]   = { "standard",   SERVO_DEFAULT_MIN_NS, SERVO_DEFAULT_MAX_NS,
+                                 SERVO_DEFAULT_PERIOD_NS },
+    [SERVO_PROTO_ONESHOT125] = { "oneshot125", 125000, 250000, 312500 },
+    [SERVO_PROTO_ONESHOT42]  = { "oneshot42",   41667,  83333, 104167 },
+    [SERVO_PROTO_MULTISHOT]  = { "multishot",    5000,  25000,  31250 },
 };
 
+/* All probed servos of the controller, for controller-wide commands */
+static LIST_HEAD(servo_list);
+static DEFINE_MUTEX(servo_list_lock);
+
+/* Controller-wide eventfd and the servos that raised events since the last GET_PENDING */
+static DEFINE_SPINLOCK(servo_ev_lock);
+static struct eventfd_ctx *servo_ctl_evfd;   /* servo_ev_lock */
+static u32 servo_ctl_ev_mask;
+static DECLARE_BITMAP(servo_ev_pending, SERVO_MAX_DEVICES);
+static_assert(SERVO_PENDING_WORDS * 64 >= SERVO_MAX_DEVICES);
+
+/* Bumped by every COMMIT */
+static atomic_t servo_commit_gen = ATOMIC_INIT(0);
+
+static struct dentry *servo_debugfs_root;
+static struct workqueue_struct *servo_wq;
+
+static unsigned int tick_margin_us = 200;
+module_param(tick_margin_us, uint, 0644);
+MODULE_PARM_DESC(tick_margin_us, "submit each tick's duty this long before the PWM frame boundary");
+
+/* One chrdev region and class for all servos; minors from servo_ida */
+static dev_t servo_devt_base;
+static struct class *servo_class;
+static DEFINE_IDA(servo_ida);
+
 static inline unsigned int map_angle_to_pulse_ns(struct servo_dev *sd, int angle)
 {
-    unsigned int min_ns = sd->limits.min_pulse_ns;
-    unsigned int max_ns = sd->limits.max_pulse_ns;
-    unsigned int span   = max_ns - min_ns;
+    return servo_core_pulse_ns(&sd->limits, (s64)angle * 1000);
+}
 
-    if (angle < sd->limits.min_angle) angle = sd->limits.min_angle;
-    if (angle > sd->limits.max_angle) angle = sd->limits.max_angle;
+/* Sub-degree resolution for trajectories and streaming */
+static inline unsigned int map_mdeg_to_pulse_ns(struct servo_dev *sd, s64 mdeg)
+{
+    return servo_core_pulse_ns(&sd->limits, mdeg);
+}
+
+/*
+ * Record events and signal the servo's and the controller's eventfd if
+ * they asked for them. Called with sd->lock held.
+ */
+static void servo_event(struct servo_dev *sd, u32 ev)
+{
+    sd->ev_pending |= ev;
+    if (sd->evfd && (ev & sd->ev_mask))
+        eventfd_signal(sd->evfd);
+
+    if (ev & READ_ONCE(servo_ctl_ev_mask)) {
+        set_bit(sd->id, servo_ev_pending);
+        spin_lock(&servo_ev_lock);
+        if (servo_ctl_evfd)
+            eventfd_signal(servo_ctl_evfd);
+        spin_unlock(&servo_ev_lock);
+    }
+}
 
-    return min_ns + (span * (unsigned int)(angle - sd->limits.min_angle)) /
-                    (unsigned int)(sd->limits.max_angle - sd->limits.min_angle);
+static int servo_apply_pulse(struct servo_dev *sd, unsigned int duty_ns)
+{
+    int ret;
+
+    KUNIT_STATIC_STUB_REDIRECT(servo_apply_pulse, sd, duty_ns);
+
+    /* Apply PWM state; an E-STOP that got in first wins */
+    mutex_lock(&sd->pwm_lock);
+    if (test_bit(SERVO_F_ESTOP, &sd->flags))
+        ret = -ESHUTDOWN;
+    else
+        ret = pwm_config(sd->pwm, duty_ns, sd->period_ns);
+    mutex_unlock(&sd->pwm_lock);
+    if (!ret)
+        sd->duty_ns = duty_ns;
+    return ret;
 }
 
 static int servo_apply_angle(struct servo_dev *sd, int angle)
 {
     int ret;
-    unsigned int duty_ns;
 
     if (!sd->enabled)
         return 0;
 
-    duty_ns = map_angle_to_pulse_ns(sd, angle);
-
-    /* Apply PWM state */
-    ret = pwm_config(sd->pwm, duty_ns, sd->period_ns);
-    if (ret)
+    ret = servo_apply_pulse(sd, map_angle_to_pulse_ns(sd, angle));
+    if (ret) {
+        if (ret != -ESHUTDOWN)
+            servo_event(sd, SERVO_EV_PWM_FAULT);
         return ret;
+    }
 
     sd->cur_angle = angle;
+    sd->cur_mdeg = angle * 1000;
+    return 0;
+}
+
+static int servo_apply_mdeg(struct servo_dev *sd, int mdeg)
+{
+    int ret;
+
+    if (!sd->enabled)
+        return 0;
+
+    ret = servo_apply_pulse(sd, map_mdeg_to_pulse_ns(sd, mdeg));
+    if (ret) {
+        if (ret != -ESHUTDOWN)
+            servo_event(sd, SERVO_EV_PWM_FAULT);
+        return ret;
+    }
+
+    sd->cur_mdeg = mdeg;
+    sd->cur_angle = DIV_ROUND_CLOSEST(mdeg, 1000);
+    return 0;
+}
+
+/* Raw pulse, inside the pulse limits; the angle follows for reporting */
+static int servo_apply_raw(struct servo_dev *sd, unsigned int duty_ns)
+{
+    int ret;
+
+    if (!sd->enabled)
+        return 0;
+
+    ret = servo_apply_pulse(sd, duty_ns);
+    if (ret) {
+        if (ret != -ESHUTDOWN)
+            servo_event(sd, SERVO_EV_PWM_FAULT);
+        return ret;
+    }
+
+    sd->cur_mdeg = servo_core_pulse_mdeg(&sd->limits, duty_ns);
+    sd->cur_angle = DIV_ROUND_CLOSEST(sd->cur_mdeg, 1000);
+    sd->target_angle = sd->cur_angle;
+    return 0;
+}
+
+/* Continuous rotation: output for velocity vel (permille) */
+static int servo_apply_velocity(struct servo_dev *sd, int vel)
+{
+    int ret;
+
+    if (!sd->enabled)
+        return 0;
+
+    ret = servo_apply_pulse(sd, servo_core_vel_pulse_ns(&sd->limits, sd->vel_neutral_ns,
+                                                        sd->vel_deadband_ns, vel));
+    if (ret) {
+        if (ret != -ESHUTDOWN)
+            servo_event(sd, SERVO_EV_PWM_FAULT);
+        return ret;
+    }
+
+    sd->vel_cur = vel;
+    return 0;
+}
+
+/* A standstill strictly inside the pulse limits, deadband included */
+static bool servo_vel_calib_ok(const struct servo_limits *l, unsigned int neutral_ns,
+                               unsigned int deadband_ns)
+{
+    unsigned int n = neutral_ns ?: l->min_pulse_ns + (l->max_pulse_ns - l->min_pulse_ns) / 2;
+
+    return n > l->min_pulse_ns && n < l->max_pulse_ns &&
+           deadband_ns < min(n - l->min_pulse_ns, l->max_pulse_ns - n);
+}
+
+/* Keep target and output inside new limits. Called with sd->lock held. */
+static int servo_limits_changed(struct servo_dev *sd)
+{
+    const struct servo_limits *l = &sd->limits;
+
+    sd->target_angle = clamp(sd->target_angle, l->min_angle, l->max_angle);
+    /* a standstill outside the new limits would turn: back to the default */
+    if (!servo_vel_calib_ok(l, sd->vel_neutral_ns, sd->vel_deadband_ns)) {
+        sd->vel_neutral_ns = 0;
+        sd->vel_deadband_ns = 0;
+    }
+    if (sd->vel_mode)
+        return servo_apply_velocity(sd, sd->vel_cur);
+    if (sd->raw_pulse_ns) {
+        sd->raw_pulse_ns = clamp(sd->raw_pulse_ns, l->min_pulse_ns, l->max_pulse_ns);
+        return servo_apply_raw(sd, sd->raw_pulse_ns);
+    }
+    /* re-apply current */
+    if (sd->enabled)
+        return servo_apply_angle(sd, clamp(sd->cur_angle, l->min_angle, l->max_angle));
+    return 0;
+}
+
+/* What the output is programmed with while disabled */
+static unsigned int servo_rest_pulse_ns(struct servo_dev *sd)
+{
+    if (sd->vel_mode)
+        return servo_core_vel_pulse_ns(&sd->limits, sd->vel_neutral_ns, 0, 0);
+    if (sd->raw_pulse_ns)
+        return sd->raw_pulse_ns;
+    return map_angle_to_pulse_ns(sd, sd->cur_angle);
+}
+
+/*
+ * Re-apply the output after a period change. A disabled output is still
+ * programmed, as in probe, so a period the PWM chip cannot do fails now
+ * and not on the next enable. Called with sd->lock held.
+ */
+static int servo_reconfigure(struct servo_dev *sd)
+{
+    int ret;
+
+    if (sd->enabled)
+        return servo_limits_changed(sd);
+    servo_limits_changed(sd);
+    ret = servo_apply_pulse(sd, servo_rest_pulse_ns(sd));
+    /* checked on the next enable instead */
+    return ret == -ESHUTDOWN ? 0 : ret;
+}
+
+/* Allocate the submission ring on first mmap. Called with sd->lock held. */
+static int servo_ring_alloc(struct servo_dev *sd)
+{
+    if (sd->ring)
+        return 0;
+    sd->ring = vmalloc_user(PAGE_ALIGN(SERVO_RING_SIZE));
+    if (!sd->ring)
+        return -ENOMEM;
+    sd->ring_head = 0;
+    return 0;
+}
+
+/* Mark everything submitted so far as consumed. Called with sd->lock held. */
+static void servo_ring_drop(struct servo_dev *sd)
+{
+    if (!sd->ring)
+        return;
+    sd->ring_head = smp_load_acquire(&sd->ring->tail);
+    smp_store_release(&sd->ring->head, sd->ring_head);
+}
+
+/*
+ * Emergency stop, output stage: latch SERVO_F_ESTOP and switch the PWM off.
+ * Only pwm_lock is taken, so this waits for at most one in-flight PWM
+ * call, never for the motion work. t0 is when the stop was requested.
+ */
+static void servo_estop_output(struct servo_dev *sd, ktime_t t0)
+{
+    u64 lat;
+
+    set_bit(SERVO_F_ESTOP, &sd->flags);
+
+    mutex_lock(&sd->pwm_lock);
+    pwm_disable(sd->pwm);
+    lat = ktime_to_ns(ktime_sub(ktime_get(), t0));
+    sd->estop_count++;
+    sd->estop_last_ns = lat;
+    if (lat > sd->estop_max_ns)
+        sd->estop_max_ns = lat;
+    mutex_unlock(&sd->pwm_lock);
+}
+
+/* Emergency stop, state: drop the motion so nothing resumes on ENABLE */
+static void servo_estop_state(struct servo_dev *sd)
+{
+    mutex_lock(&sd->lock);
+    sd->enabled = 0;
+    sd->sp_seen = atomic_read(&sd->sp_seq);
+    sd->target_angle = sd->cur_angle;
+    sd->timed_count = 0;
+    hrtimer_try_to_cancel(&sd->timed_timer);
+    sd->traj_active = false;
+    sd->traj_count = 0;
+    servo_ring_drop(sd);
+    sd->stage.mask = 0;
+    sd->vel_target = 0;
+    sd->vel_cur = 0;
+    mutex_unlock(&sd->lock);
+}
+
+static void servo_estop_all(void)
+{
+    ktime_t t0 = ktime_get();
+    struct servo_dev *sd;
+
+    mutex_lock(&servo_list_lock);
+    /* all outputs first, bookkeeping afterwards */
+    list_for_each_entry(sd, &servo_list, node)
+        servo_estop_output(sd, t0);
+    list_for_each_entry(sd, &servo_list, node)
+        servo_estop_state(sd);
+    mutex_unlock(&servo_list_lock);
+}
+
+/* Queue the motion work unless the loop is already running */
+static void servo_motion_kick(struct servo_dev *sd)
+{
+    if (!test_and_set_bit(SERVO_F_LOOP, &sd->flags))
+        queue_delayed_work(servo_wq, &sd->motion_work, 0);
+}
+
+/*
+ * Publish a new setpoint without taking sd->lock. Only the latest value
+ * matters, so a burst of SET_ANGLE calls between two ticks collapses into
+ * a single target update.
+ */
+static void servo_publish_setpoint(struct servo_dev *sd, int angle)
+{
+    if (READ_ONCE(sd->stream_on))
+        atomic64_set(&sd->sp_stamp, ktime_get_ns());
+    atomic_set(&sd->sp_angle, angle);
+    smp_mb__before_atomic();
+    atomic_inc(&sd->sp_seq);
+    servo_motion_kick(sd);
+}
+
+/* New explicit target; ends a running trajectory. Called with sd->lock held. */
+static void servo_set_target(struct servo_dev *sd, int angle)
+{
+    if (angle < sd->limits.min_angle) angle = sd->limits.min_angle;
+    if (angle > sd->limits.max_angle) angle = sd->limits.max_angle;
+    sd->target_angle = angle;
+    sd->raw_pulse_ns = 0;
+    sd->traj_active = false;
+    sd->traj_count = 0;
+}
+
+/* New raw pulse target; ends angle motion. Called with sd->lock held. */
+static void servo_set_pulse_target(struct servo_dev *sd, unsigned int duty_ns)
+{
+    sd->raw_pulse_ns = clamp(duty_ns, sd->limits.min_pulse_ns, sd->limits.max_pulse_ns);
+    sd->target_angle = sd->cur_angle;
+    sd->traj_active = false;
+    sd->traj_count = 0;
+}
+
+/*
+ * Streaming: start a segment from the current output to the new setpoint.
+ * Its duration tracks the arrival interval, so a 30 Hz producer gives a
+ * continuous ramp instead of one step every few ticks.
+ */
+static void servo_stream_setpoint(struct servo_dev *sd, ktime_t arrival, ktime_t now)
+{
+    s64 interval;
+
+    /* unstamped (published before streaming was on) counts as now */
+    if (!ktime_after(arrival, sd->stream_t0))
+        arrival = now;
+
+    interval = ktime_to_ns(ktime_sub(arrival, sd->stream_t0));
+    if (sd->stream_t0 && interval <= SERVO_STREAM_MAX_NS)
+        sd->stream_dur_ns = (3 * sd->stream_dur_ns + interval) / 4;
+
+    sd->stream_raw = sd->raw_pulse_ns != 0;
+    if (sd->stream_raw) {
+        sd->stream_from = sd->duty_ns ?: map_mdeg_to_pulse_ns(sd, sd->cur_mdeg);
+        sd->stream_to = sd->raw_pulse_ns;
+    } else {
+        sd->stream_from = sd->cur_mdeg;
+        sd->stream_to = sd->target_angle * 1000;
+    }
+    sd->stream_t0 = arrival;
+    sd->stream_moving = true;
+}
+
+/* Advance the stream segment to now and apply it. Called with sd->lock held. */
+static void servo_stream_step(struct servo_dev *sd, ktime_t now)
+{
+    s64 lo = (s64)sd->limits.min_angle * 1000;
+    s64 hi = (s64)sd->limits.max_angle * 1000;
+    s64 pos;
+    int held;
+
+    pos = servo_core_stream_pos(sd->stream_from, sd->stream_to, sd->stream_dur_ns,
+                                sd->stream_horizon_ns,
+                                ktime_to_ns(ktime_sub(now, sd->stream_t0)), &held);
+    if (held)
+        sd->stream_moving = false;
+    if (sd->stream_raw)
+        servo_apply_raw(sd, clamp_t(s64, pos, sd->limits.min_pulse_ns, sd->limits.max_pulse_ns));
+    else
+        servo_apply_mdeg(sd, clamp(pos, lo, hi));
+}
+
+/* Take the latest published setpoint, if any. Called with sd->lock held. */
+static void servo_consume_setpoint(struct servo_dev *sd, ktime_t now)
+{
+    unsigned int seq = atomic_read_acquire(&sd->sp_seq);
+
+    if (seq == sd->sp_seen)
+        return;
+    sd->sp_seen = seq;
+
+    servo_set_target(sd, atomic_read(&sd->sp_angle));
+    if (sd->stream_on)
+        servo_stream_setpoint(sd, ns_to_ktime(atomic64_read(&sd->sp_stamp)), now);
+}
+
+/* ---------- Submission ring ---------- */
+
+/*
+ * Drain the ring at tick time. Entries and tail live in user memory and
+ * may change under us: every field is read once and a producer that ran
+ * more than a ring ahead only loses the oldest entries.
+ * Called with sd->lock held.
+ */
+static void servo_ring_consume(struct servo_dev *sd, ktime_t now)
+{
+    struct servo_ring *r = sd->ring;
+    u32 head = sd->ring_head, tail;
+    bool setpoint = false;
+
+    if (!r)
+        return;
+
+    /* ticking: no doorbell needed */
+    WRITE_ONCE(r->flags, 0);
+
+    tail = smp_load_acquire(&r->tail);
+    if (tail == head) {
+        if (sd->ring_idle)
+            sd->ring_idle--;
+        return;
+    }
+    if (tail - head > SERVO_RING_ENTRIES)
+        head = tail - SERVO_RING_ENTRIES;
+
+    for (; head != tail; head++) {
+        const struct servo_ring_entry *e = &r->entries[head % SERVO_RING_ENTRIES];
+        int value = READ_ONCE(e->value);
+
+        switch (READ_ONCE(e->op)) {
+        case SERVO_RING_OP_ANGLE:
+            /* velocity mode: skipped, as SET_ANGLE gets -EBUSY */
+            if (sd->vel_mode)
+                break;
+            servo_set_target(sd, value);
+            setpoint = true;
+            break;
+        case SERVO_RING_OP_SPEED:
+            sd->speed_dps = max(value, 0);
+            break;
+        case SERVO_RING_OP_PULSE:
+            if (sd->vel_mode)
+                break;
+            servo_set_pulse_target(sd, max(value, 0));
+            setpoint = true;
+            break;
+        }
+    }
+
+    sd->ring_head = head;
+    smp_store_release(&r->head, head);
+    sd->ring_idle = SERVO_RING_IDLE_TICKS;
+
+    /* like a burst of SET_ANGLE: one stream segment to the newest setpoint */
+    if (setpoint && sd->stream_on)
+        servo_stream_setpoint(sd, now, now);
+}
+
+/* ---------- Staged commit ---------- */
+
+/* Reject a STAGE request before anything is recorded */
+static int servo_stage_check(const struct servo_stage *sg)
+{
+    if ((sg->mask & ~SERVO_STAGE_ALL) || sg->reserved)
+        return -EINVAL;
+    if ((sg->mask & SERVO_STAGE_ANGLE) && (sg->mask & SERVO_STAGE_PULSE))
+        return -EINVAL;
+    if ((sg->mask & SERVO_STAGE_LIMITS) &&
+        (sg->limits.max_angle <= sg->limits.min_angle ||
+         sg->limits.max_pulse_ns <= sg->limits.min_pulse_ns))
+        return -EINVAL;
+    return 0;
+}
+
+/*
+ * Checks against the servo's current state: no position setpoints in
+ * velocity mode, limits within the frame as in SET_LIMITS.
+ * Called with sd->lock held.
+ */
+static int servo_stage_fits(struct servo_dev *sd, const struct servo_stage *sg)
+{
+    if ((sg->mask & SERVO_STAGE_LIMITS) && sg->limits.max_pulse_ns >= sd->period_ns)
+        return -EINVAL;
+    if ((sg->mask & (SERVO_STAGE_ANGLE | SERVO_STAGE_PULSE)) && sd->vel_mode)
+        return -EBUSY;
+    return 0;
+}
+
+/* Apply the staged changes once committed. Called with sd->lock held. */
+static void servo_stage_apply(struct servo_dev *sd, ktime_t now)
+{
+    const struct servo_stage *sg = &sd->stage;
+
+    if (!sg->mask || sd->stage_gen == (u32)atomic_read(&servo_commit_gen))
+        return;
+
+    /* the period changed since STAGE: drop it rather than fault every tick */
+    if (servo_stage_fits(sd, sg) == -EINVAL) {
+        sd->stage.mask = 0;
+        servo_event(sd, SERVO_EV_PWM_FAULT);
+        return;
+    }
+
+    if (sg->mask & SERVO_STAGE_SPEED)
+        sd->speed_dps = max(sg->speed_dps, 0);
+    if (sg->mask & SERVO_STAGE_LIMITS) {
+        sd->limits = sg->limits;
+        servo_limits_changed(sd);
+    }
+    /* switched to velocity mode since STAGE: the position part lapses */
+    if ((sg->mask & (SERVO_STAGE_ANGLE | SERVO_STAGE_PULSE)) && !sd->vel_mode) {
+        if (sg->mask & SERVO_STAGE_ANGLE)
+            servo_set_target(sd, sg->angle);
+        else
+            servo_set_pulse_target(sd, sg->pulse_ns);
+        if (sd->stream_on)
+            servo_stream_setpoint(sd, now, now);
+    }
+    sd->stage.mask = 0;
+}
+
+/* Merge a checked STAGE request. Called with sd->lock held. */
+static void servo_stage_add(struct servo_dev *sd, const struct servo_stage *sg)
+{
+    /* committed but not ticked yet: belongs to that commit, not this one */
+    servo_stage_apply(sd, ktime_get());
+
+    if (!sg->mask) {
+        sd->stage.mask = 0;
+        return;
+    }
+    if (!sd->stage.mask)
+        sd->stage_gen = atomic_read(&servo_commit_gen);
+    /* angle and raw pulse replace each other */
+    if (sg->mask & SERVO_STAGE_ANGLE) {
+        sd->stage.angle = sg->angle;
+        sd->stage.mask &= ~SERVO_STAGE_PULSE;
+    }
+    if (sg->mask & SERVO_STAGE_PULSE) {
+        sd->stage.pulse_ns = sg->pulse_ns;
+        sd->stage.mask &= ~SERVO_STAGE_ANGLE;
+    }
+    if (sg->mask & SERVO_STAGE_SPEED)
+        sd->stage.speed_dps = sg->speed_dps;
+    if (sg->mask & SERVO_STAGE_LIMITS)
+        sd->stage.limits = sg->limits;
+    sd->stage.mask |= sg->mask;
+}
+
+/*
+ * Release everything staged on all servos. The generation bump is the
+ * commit point; the kicks only get idle loops to their next tick.
+ * Called with servo_list_lock held.
+ */
+static void servo_commit_locked(void)
+{
+    struct servo_dev *sd;
+
+    atomic_inc(&servo_commit_gen);
+    list_for_each_entry(sd, &servo_list, node) {
+        mutex_lock(&sd->lock);
+        if (sd->stage.mask)
+            servo_motion_kick(sd);
+        mutex_unlock(&sd->lock);
+    }
+}
+
+static void servo_commit(void)
+{
+    mutex_lock(&servo_list_lock);
+    servo_commit_locked();
+    mutex_unlock(&servo_list_lock);
+}
+
+/*
+ * Stop ticking; re-kick if a setpoint or ring entry slipped in after the
+ * last consume. A ring producer sees NEED_WAKEUP from here on.
+ */
+static void servo_motion_idle(struct servo_dev *sd)
+{
+    sd->tick_due = 0;
+    if (sd->ring)
+        WRITE_ONCE(sd->ring->flags, SERVO_RING_NEED_WAKEUP);
+    clear_bit(SERVO_F_LOOP, &sd->flags);
+    smp_mb__after_atomic();
+    if ((unsigned int)atomic_read(&sd->sp_seq) != sd->sp_seen ||
+        (sd->ring && READ_ONCE(sd->ring->tail) != sd->ring_head))
+        servo_motion_kick(sd);
+}
+
+/* Enable/disable the output. Called with sd->lock held. */
+static int servo_set_enabled(struct servo_dev *sd, int val)
+{
+    int ret = 0;
+
+    if (val && !sd->enabled) {
+        mutex_lock(&sd->pwm_lock);
+        clear_bit(SERVO_F_ESTOP, &sd->flags);
+        ret = pwm_enable(sd->pwm);
+        mutex_unlock(&sd->pwm_lock);
+        if (!ret) {
+            sd->enabled = 1;
+            sd->frame_t0 = ktime_get();
+            /* apply current angle (or raw pulse) immediately; a
+               continuous servo restarts from standstill */
+            if (sd->vel_mode)
+                servo_apply_velocity(sd, 0);
+            else if (sd->raw_pulse_ns)
+                servo_apply_raw(sd, sd->raw_pulse_ns);
+            else
+                servo_apply_angle(sd, sd->cur_angle);
+            /* let the motion loop pick up pending setpoints */
+            servo_motion_kick(sd);
+        }
+    } else if (!val && sd->enabled) {
+        /* the motion loop sees !enabled and goes idle by itself */
+        sd->enabled = 0;
+        sd->vel_cur = 0;
+        mutex_lock(&sd->pwm_lock);
+        pwm_disable(sd->pwm);
+        mutex_unlock(&sd->pwm_lock);
+    }
+    return ret;
+}
+
+/* Arm the hrtimer for the earliest scheduled command. Called with sd->lock held. */
+static void servo_timed_arm(struct servo_dev *sd)
+{
+    if (sd->timed_count)
+        hrtimer_start(&sd->timed_timer, sd->timed[0].deadline, HRTIMER_MODE_ABS);
+    else
+        hrtimer_try_to_cancel(&sd->timed_timer);
+}
+
+static int servo_timed_queue(struct servo_dev *sd, enum servo_timed_op op,
+                             const struct servo_timed *t)
+{
+    ktime_t deadline = ns_to_ktime(t->deadline_ns);
+    unsigned int i;
+
+    if (sd->timed_count == SERVO_TIMED_DEPTH)
+        return -ENOSPC;
+
+    /* sorted insert; equal deadlines keep submission order */
+    for (i = sd->timed_count; i > 0 && ktime_after(sd->timed[i - 1].deadline, deadline); i--)
+        sd->timed[i] = sd->timed[i - 1];
+    sd->timed[i].deadline = deadline;
+    sd->timed[i].op = op;
+    sd->timed[i].value = t->value;
+    sd->timed_count++;
+
+    if (i == 0)
+        servo_timed_arm(sd);
+    return 0;
+}
+
+/* Execute all scheduled commands that are due. Called with sd->lock held. */
+static void servo_timed_run(struct servo_dev *sd, ktime_t now)
+{
+    struct servo_timed_cmd *c;
+    unsigned int n = 0;
+    bool setpoint = false;
+
+    while (n < sd->timed_count && !ktime_after(sd->timed[n].deadline, now)) {
+        c = &sd->timed[n++];
+        switch (c->op) {
+        case SERVO_TIMED_ANGLE:
+            servo_set_target(sd, c->value);
+            setpoint = true;
+            break;
+        case SERVO_TIMED_ENABLE:
+            servo_set_enabled(sd, c->value);
+            break;
+        }
+    }
+    if (!n)
+        return;
+
+    /* streaming only moves on a new segment */
+    if (setpoint && sd->stream_on)
+        servo_stream_setpoint(sd, now, now);
+
+    sd->timed_count -= n;
+    memmove(sd->timed, sd->timed + n, sd->timed_count * sizeof(sd->timed[0]));
+    servo_timed_arm(sd);
+}
+
+/* hrtimer: pull the next tick forward to the command deadline */
+static enum hrtimer_restart servo_timed_fire(struct hrtimer *t)
+{
+    struct servo_dev *sd = container_of(t, struct servo_dev, timed_timer);
+
+    set_bit(SERVO_F_LOOP, &sd->flags);
+    /* the pulled-in tick re-arms the frame-aligned one */
+    hrtimer_try_to_cancel(&sd->tick_timer);
+    mod_delayed_work(servo_wq, &sd->motion_work, 0);
+    return HRTIMER_NORESTART;
+}
+
+/* ---------- Spline trajectory ---------- */
+
+static inline const struct servo_knot *servo_knot_at(struct servo_dev *sd, unsigned int i)
+{
+    return &sd->traj[(sd->traj_head + i) % SERVO_TRAJ_MAX_KNOTS];
+}
+
+/* Tangent at knot i; the ends of the loaded data start/stop at rest */
+static s64 servo_knot_tangent(struct servo_dev *sd, unsigned int i)
+{
+    return servo_core_tangent(i ? servo_knot_at(sd, i - 1) : NULL, servo_knot_at(sd, i),
+                              i + 1 < sd->traj_count ? servo_knot_at(sd, i + 1) : NULL);
+}
+
+/* Advance the trajectory to now and apply it. Called with sd->lock held. */
+static void servo_traj_step(struct servo_dev *sd, ktime_t now)
+{
+    s64 t_us = ktime_us_delta(now, sd->traj_start);
+    int lo = sd->limits.min_angle * 1000;
+    int hi = sd->limits.max_angle * 1000;
+    const struct servo_knot *last;
+    unsigned int i;
+
+    if (t_us < 0)
+        return; /* not started yet */
+
+    /* segment [k(i), k(i+1)] needs k(i-1) for its tangent, nothing older */
+    while (sd->traj_count >= 3 && t_us >= (s64)servo_knot_at(sd, 2)->t_ms * 1000) {
+        sd->traj_head = (sd->traj_head + 1) % SERVO_TRAJ_MAX_KNOTS;
+        sd->traj_count--;
+    }
+
+    last = servo_knot_at(sd, sd->traj_count - 1);
+    if (sd->traj_count < 2 || t_us >= (s64)last->t_ms * 1000) {
+        /* done: hold the final knot, keep it for a later APPEND */
+        servo_apply_mdeg(sd, clamp(last->angle_mdeg, lo, hi));
+        sd->traj_active = false;
+        servo_event(sd, SERVO_EV_TRAJ_UNDERRUN);
+        return;
+    }
+
+    i = (t_us >= (s64)servo_knot_at(sd, 1)->t_ms * 1000) ? 1 : 0;
+    /* knots outside the limits, or overshoot between knots inside them */
+    servo_apply_mdeg(sd, clamp(servo_core_hermite(servo_knot_at(sd, i), servo_knot_at(sd, i + 1),
+                                                  servo_knot_tangent(sd, i),
+                                                  servo_knot_tangent(sd, i + 1), t_us),
+                               lo, hi));
+}
+
+/* Load or append knots. Called with sd->lock held. */
+static int servo_traj_load(struct servo_dev *sd, const struct servo_traj *tr,
+                           const struct servo_knot *k)
+{
+    bool append = tr->flags & SERVO_TRAJ_APPEND;
+    u32 prev_t;
+    unsigned int i, n, first = 0;
+
+    if (append && !sd->traj_count)
+        return -EINVAL;
+
+    for (i = 0; i < tr->count; i++) {
+        if (k[i].flags & ~SERVO_KNOT_VEL)
+            return -EINVAL;
+        if (abs(k[i].vel_mdps) > SERVO_TRAJ_MAX_VEL_MDPS)
+            return -EINVAL;
+        if (i && k[i].t_ms <= k[i - 1].t_ms)
+            return -EINVAL;
+    }
+
+    if (append) {
+        prev_t = servo_knot_at(sd, sd->traj_count - 1)->t_ms;
+        if (k[0].t_ms <= prev_t)
+            return -EINVAL;
+    } else if (k[0].t_ms > 0) {
+        /* leave the current position smoothly: implicit knot at rest */
+        first = 1;
+    }
+
+    n = append ? sd->traj_count : 0;
+    if (n + first + tr->count > SERVO_TRAJ_MAX_KNOTS)
+        return -ENOSPC;
+
+    if (!sd->traj) {
+        sd->traj = kvmalloc_array(SERVO_TRAJ_MAX_KNOTS, sizeof(*sd->traj), GFP_KERNEL);
+        if (!sd->traj)
+            return -ENOMEM;
+    }
+
+    if (!append) {
+        sd->traj_head = 0;
+        sd->traj_count = 0;
+        sd->traj_start = tr->start_ns ? ns_to_ktime(tr->start_ns) : ktime_get();
+        if (first) {
+            sd->traj[0].t_ms = 0;
+            sd->traj[0].angle_mdeg = sd->cur_mdeg;
+            sd->traj[0].vel_mdps = 0;
+            sd->traj[0].flags = SERVO_KNOT_VEL;
+            sd->traj_count = 1;
+        }
+    }
+
+    for (i = 0; i < tr->count; i++)
+        sd->traj[(sd->traj_head + sd->traj_count++) % SERVO_TRAJ_MAX_KNOTS] = k[i];
+
+    sd->target_angle = clamp_t(int, DIV_ROUND_CLOSEST(k[tr->count - 1].angle_mdeg, 1000),
+                               sd->limits.min_angle, sd->limits.max_angle);
+    sd->raw_pulse_ns = 0;
+    sd->traj_active = true;
+    servo_motion_kick(sd);
     return 0;
 }
 
+/* The tick period in effect: tick_us rounded to whole PWM frames */
+static s64 servo_tick_ns(struct servo_dev *sd)
+{
+    s64 period = sd->period_ns;
+
+    return max_t(s64, div64_s64((s64)sd->tick_us * NSEC_PER_USEC + period / 2, period), 1) *
+           period;
+}
+
+/* The same in us, for the per-tick step sizes */
+static unsigned int servo_tick_eff_us(struct servo_dev *sd)
+{
+    return div_s64(servo_tick_ns(sd), NSEC_PER_USEC);
+}
+
+/* Whether the motion loop has to keep ticking. Called with sd->lock held. */
+static bool servo_motion_busy(struct servo_dev *sd)
+{
+    if (!sd->enabled || test_bit(SERVO_F_ESTOP, &sd->flags))
+        return false;
+    if (sd->vel_mode)
+        return sd->vel_cur != sd->vel_target || sd->ring_idle;
+    if (sd->traj_active || sd->ring_idle)
+        return true;
+    if (sd->stream_on)
+        return sd->stream_moving;
+    return sd->speed_dps > 0 && sd->cur_angle != sd->target_angle;
+}
+
+/*
+ * One control tick at time now: consume setpoints, run due commands and
+ * advance the motion. Returns true while the loop has to keep ticking.
+ * Called with sd->lock held.
+ */
+static bool servo_motion_step(struct servo_dev *sd, ktime_t now)
+{
+    servo_consume_setpoint(sd, now);
+    servo_ring_consume(sd, now);
+    servo_stage_apply(sd, now);
+    servo_timed_run(sd, now);
+
+    if (!sd->enabled || test_bit(SERVO_F_ESTOP, &sd->flags))
+        goto out;
+
+    if (sd->vel_mode) {
+        /* ramp; servo_core_step() is unit-agnostic */
+        if (sd->vel_cur != sd->vel_target)
+            servo_apply_velocity(sd, servo_core_step(sd->vel_cur, sd->vel_target,
+                                 sd->vel_ramp ? servo_core_step_deg_us(sd->vel_ramp,
+                                                                       servo_tick_eff_us(sd))
+                                              : 2 * SERVO_VELOCITY_MAX));
+        goto out;
+    }
+
+    if (sd->traj_active) {
+        servo_traj_step(sd, now);
+        goto out;
+    }
+
+    if (sd->stream_on) {
+        if (sd->stream_moving)
+            servo_stream_step(sd, now);
+        goto out;
+    }
+
+    if (sd->raw_pulse_ns) {
+        if (sd->duty_ns != sd->raw_pulse_ns)
+            servo_apply_raw(sd, sd->raw_pulse_ns);
+        goto out;
+    }
+
+    if (sd->cur_angle == sd->target_angle)
+        goto out;
+
+    if (sd->speed_dps == 0) {
+        /* jump mode: one apply per tick, however many setpoints arrived */
+        servo_apply_angle(sd, sd->target_angle);
+    } else {
+        servo_apply_angle(sd, servo_core_step(sd->cur_angle, sd->target_angle,
+                                              servo_core_step_deg_us(sd->speed_dps,
+                                                                     servo_tick_eff_us(sd))));
+    }
+    if (sd->cur_angle == sd->target_angle)
+        servo_event(sd, SERVO_EV_TARGET_REACHED);
+
+out:
+    return servo_motion_busy(sd);
+}
+
+/*
+ * When the next tick should run: tick_margin_us before the frame boundary
+ * one tick (servo_tick_ns()) after the boundary this tick was meant for.
+ * Each tick's pwm_config() then lands in exactly one frame, as far as
+ * frame_t0 tracks the hardware. Called with sd->lock held.
+ */
+static ktime_t servo_next_tick(struct servo_dev *sd, ktime_t now)
+{
+    s64 period = sd->period_ns;
+    s64 margin = min_t(s64, (s64)tick_margin_us * NSEC_PER_USEC, period / 2);
+    s64 since = ktime_to_ns(ktime_sub(now, sd->frame_t0)) + margin;
+    s64 frame = div64_s64(since + period / 2, period);
+
+    return ktime_add_ns(sd->frame_t0, frame * period + servo_tick_ns(sd) - margin);
+}
+
+static enum hrtimer_restart servo_tick_fire(struct hrtimer *t)
+{
+    struct servo_dev *sd = container_of(t, struct servo_dev, tick_timer);
+
+    queue_delayed_work(servo_wq, &sd->motion_work, 0);
+    return HRTIMER_NORESTART;
+}
+
 /* Motion control loop: moves cur_angle -> target_angle with speed */
 static void servo_motion_tick(struct work_struct *work)
 {
     struct servo_dev *sd = container_of(to_delayed_work(work), struct servo_dev, motion_work);
-    int step_deg, delta, next_angle;
+    ktime_t now;
 
     mutex_lock(&sd->lock);
 
-    if (!sd->enabled || sd->speed_dps == 0 || sd->cur_angle == sd->target_angle)
-        goto out_resched_if_needed;
+    now = ktime_get();
+    trace_servo_tick(sd->id, ktime_to_ns(now), ktime_to_ns(sd->tick_due), sd->cur_mdeg);
 
-    /* degrees per tick */
-    step_deg = (sd->speed_dps * sd->tick_ms + 500) / 1000; /* round */
+    if (servo_motion_step(sd, now) && !test_bit(SERVO_F_DEAD, &sd->flags)) {
+        /* phase-locked to the PWM frames, not to jiffies */
+        sd->tick_due = servo_next_tick(sd, now);
+        hrtimer_start(&sd->tick_timer, sd->tick_due, HRTIMER_MODE_ABS);
+    } else {
+        servo_motion_idle(sd);
+    }
 
-    if (step_deg <= 0)
-        step_deg = 1;
+    mutex_unlock(&sd->lock);
+}
 
-    delta = sd->target_angle - sd->cur_angle;
-    if (delta > 0) {
-        next_angle = sd->cur_angle + min(step_deg, delta);
+static void servo_set_speed(struct servo_dev *sd, int val)
+{
+    mutex_lock(&sd->lock);
+    sd->speed_dps = (val < 0) ? 0 : val;
+    if (sd->enabled && sd->speed_dps > 0 && sd->cur_angle != sd->target_angle)
+        servo_motion_kick(sd);
+    mutex_unlock(&sd->lock);
+}
+
+static int servo_set_limits(struct servo_dev *sd, const struct servo_limits *lims)
+{
+    int ret = 0;
+
+    if (lims->max_angle <= lims->min_angle)
+        return -EINVAL;
+    if (lims->max_pulse_ns <= lims->min_pulse_ns)
+        return -EINVAL;
+
+    mutex_lock(&sd->lock);
+    if (lims->max_pulse_ns >= sd->period_ns) {
+        ret = -EINVAL;
     } else {
-        next_angle = sd->cur_angle - min(step_deg, -delta);
+        sd->limits = *lims;
+        ret = servo_limits_changed(sd);
+    }
+    mutex_unlock(&sd->lock);
+    return ret;
+}
+
+/* Switch between position and velocity mode. Called with sd->lock held. */
+static int servo_set_rotation(struct servo_dev *sd, const struct servo_rotation *r)
+{
+    if (r->mode > SERVO_MODE_VELOCITY || r->ramp_pmps > SERVO_VEL_MAX_RAMP)
+        return -EINVAL;
+    if (!servo_vel_calib_ok(&sd->limits, r->neutral_ns, r->deadband_ns))
+        return -EINVAL;
+
+    sd->vel_neutral_ns = r->neutral_ns;
+    sd->vel_deadband_ns = r->deadband_ns;
+    sd->vel_ramp = r->ramp_pmps;
+
+    if (r->mode == SERVO_MODE_VELOCITY && !sd->vel_mode) {
+        /* drop the position motion, start at standstill */
+        servo_set_target(sd, sd->cur_angle);
+        sd->stream_moving = false;
+        sd->vel_target = 0;
+        WRITE_ONCE(sd->vel_mode, true);
+        return servo_apply_velocity(sd, 0);
+    }
+    if (r->mode == SERVO_MODE_POSITION && sd->vel_mode) {
+        WRITE_ONCE(sd->vel_mode, false);
+        sd->vel_target = 0;
+        sd->vel_cur = 0;
+        return servo_apply_angle(sd, sd->cur_angle);
+    }
+    /* new calibration for the running velocity */
+    return sd->vel_mode ? servo_apply_velocity(sd, sd->vel_cur) : 0;
+}
+
+/*
+ * Switch protocol and/or frame period and re-apply the output; the old
+ * settings come back if the PWM refuses. Called with sd->lock held.
+ */
+static int servo_set_protocol(struct servo_dev *sd, const struct servo_protocol *p)
+{
+    struct servo_limits old_limits = sd->limits;
+    unsigned int old_period = sd->period_ns, old_protocol = sd->protocol;
+    unsigned int old_neutral = sd->vel_neutral_ns, old_deadband = sd->vel_deadband_ns;
+    const struct servo_proto *d;
+    unsigned int period;
+    int ret;
+
+    if (p->protocol >= ARRAY_SIZE(servo_protos))
+        return -EINVAL;
+    d = &servo_protos[p->protocol];
+    period = p->period_ns ?: d->period_ns;
+    if (period > SERVO_MAX_PERIOD_NS ||
+        period <= (p->protocol == sd->protocol ? sd->limits.max_pulse_ns : d->max_ns))
+        return -EINVAL;
+
+    if (p->protocol != sd->protocol) {
+        sd->limits.min_pulse_ns = d->min_ns;
+        sd->limits.max_pulse_ns = d->max_ns;
+        sd->vel_neutral_ns = 0;
+        sd->vel_deadband_ns = 0;
+    }
+    sd->protocol = p->protocol;
+    sd->period_ns = period;
+    if (period != old_period)
+        sd->frame_t0 = ktime_get();
+
+    ret = servo_reconfigure(sd);
+    if (ret) {
+        sd->limits = old_limits;
+        sd->period_ns = old_period;
+        sd->protocol = old_protocol;
+        sd->vel_neutral_ns = old_neutral;
+        sd->vel_deadband_ns = old_deadband;
+        servo_reconfigure(sd);
+    }
+    return ret;
+}
+
+/* SET_TIMING: period within the protocol and tick. Called with sd->lock held. */
+static int servo_set_timing(struct servo_dev *sd, const struct servo_timing *t)
+{
+    struct servo_protocol p = { .protocol = sd->protocol, .period_ns = t->period_ns };
+    int ret;
+
+    if (t->reserved)
+        return -EINVAL;
+    if (t->tick_us && (t->tick_us < SERVO_MIN_TICK_US || t->tick_us > SERVO_MAX_TICK_US))
+        return -EINVAL;
+    if (t->period_ns) {
+        ret = servo_set_protocol(sd, &p);
+        if (ret)
+            return ret;
+    }
+    if (t->tick_us)
+        sd->tick_us = t->tick_us;
+    return 0;
+}
+
+/* Check a SET_EVENTFD request and look up its eventfd; NULL for fd -1 */
+static struct eventfd_ctx *servo_eventfd_get(const struct servo_eventfd *ef, u32 flags)
+{
+    if (ef->flags != flags || (ef->mask & ~SERVO_EV_ALL) || ef->reserved)
+        return ERR_PTR(-EINVAL);
+    return ef->fd >= 0 ? eventfd_ctx_fdget(ef->fd) : NULL;
+}
+
+/* Read and clear the servos with controller events pending */
+static int servo_get_pending(struct servo_pending __user *up)
+{
+    struct servo_pending p = {};
+    unsigned int id;
+
+    for_each_set_bit(id, servo_ev_pending, SERVO_MAX_DEVICES)
+        if (test_and_clear_bit(id, servo_ev_pending))
+            p.ids[id / 64] |= 1ULL << (id % 64);
+    return copy_to_user(up, &p, sizeof(p)) ? -EFAULT : 0;
+}
+
+/* Snapshot for GET_STATE. Called with sd->lock held. */
+static void servo_get_state(struct servo_dev *sd, struct servo_state *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->stamp_ns     = ktime_get_ns();
+    st->index        = sd->id;
+    st->cur_angle    = sd->cur_angle;
+    st->target_angle = sd->target_angle;
+    st->cur_mdeg     = sd->cur_mdeg;
+    st->speed_dps    = sd->speed_dps;
+    st->limits       = sd->limits;
+    st->pulse_ns     = sd->duty_ns;
+    st->timed_depth  = sd->timed_count;
+    st->velocity     = sd->vel_cur;
+    st->target_velocity = sd->vel_target;
+    st->traj_depth   = sd->traj_count;
+    if (sd->ring)
+        st->ring_depth = min_t(u32, READ_ONCE(sd->ring->tail) - sd->ring_head,
+                               SERVO_RING_ENTRIES);
+
+    if (sd->enabled)
+        st->flags |= SERVO_STATE_ENABLED;
+    if (test_bit(SERVO_F_ESTOP, &sd->flags))
+        st->flags |= SERVO_STATE_ESTOP;
+    if (sd->traj_active)
+        st->flags |= SERVO_STATE_TRAJ;
+    if (sd->stream_on)
+        st->flags |= SERVO_STATE_STREAM;
+    if (sd->raw_pulse_ns)
+        st->flags |= SERVO_STATE_RAW;
+    if (sd->vel_mode) {
+        st->flags |= SERVO_STATE_VELOCITY;
+        if (sd->enabled && sd->vel_cur)
+            st->flags |= SERVO_STATE_MOVING;
+    } else if (sd->enabled && (sd->traj_active || sd->stream_moving ||
+                               (!sd->stream_on && sd->cur_angle != sd->target_angle))) {
+        st->flags |= SERVO_STATE_MOVING;
+    }
+}
+
+/* ---------- Char device ---------- */
+
+static long servo_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct servo_dev *sd = filp->private_data;
+    int val, ret = 0;
+
+    switch (cmd) {
+    case SERVO_IOCTL_ENABLE:
+        if (copy_from_user(&val, (void __user *)arg, sizeof(int)))
+            return -EFAULT;
+        mutex_lock(&sd->lock);
+        ret = servo_set_enabled(sd, val);
+        mutex_unlock(&sd->lock);
+        break;
+
+    case SERVO_IOCTL_ESTOP:
+        servo_estop_output(sd, ktime_get());
+        servo_estop_state(sd);
+        break;
+
+    case SERVO_IOCTL_ESTOP_ALL:
+        servo_estop_all();
+        break;
+
+    case SERVO_IOCTL_SET_ANGLE:
+        if (copy_from_user(&val, (void __user *)arg, sizeof(int)))
+            return -EFAULT;
+        if (READ_ONCE(sd->vel_mode))
+            return -EBUSY;
+        /* lock-free: clamped and applied by the next motion tick */
+        servo_publish_setpoint(sd, val);
+        break;
+
+    case SERVO_IOCTL_SET_ANGLE_AT:
+    case SERVO_IOCTL_ENABLE_AT: {
+        struct servo_timed t;
+        if (copy_from_user(&t, (void __user *)arg, sizeof(t)))
+            return -EFAULT;
+        if (t.deadline_ns < 0 || t.reserved)
+            return -EINVAL;
+        mutex_lock(&sd->lock);
+        if (cmd == SERVO_IOCTL_SET_ANGLE_AT && sd->vel_mode)
+            ret = -EBUSY;
+        else
+            ret = servo_timed_queue(sd, cmd == SERVO_IOCTL_ENABLE_AT ?
+                                    SERVO_TIMED_ENABLE : SERVO_TIMED_ANGLE, &t);
+        mutex_unlock(&sd->lock);
+        break;
+    }
+
+    case SERVO_IOCTL_TRAJ_LOAD: {
+        struct servo_traj tr;
+        struct servo_knot *k;
+        if (copy_from_user(&tr, (void __user *)arg, sizeof(tr)))
+            return -EFAULT;
+        if (!tr.count || tr.count > SERVO_TRAJ_MAX_KNOTS ||
+            (tr.flags & ~SERVO_TRAJ_APPEND) || tr.start_ns < 0)
+            return -EINVAL;
+        k = memdup_array_user(u64_to_user_ptr(tr.knots), tr.count, sizeof(*k));
+        if (IS_ERR(k))
+            return PTR_ERR(k);
+        mutex_lock(&sd->lock);
+        ret = sd->vel_mode ? -EBUSY : servo_traj_load(sd, &tr, k);
+        mutex_unlock(&sd->lock);
+        kfree(k);
+        break;
+    }
+
+    case SERVO_IOCTL_TRAJ_STOP:
+        mutex_lock(&sd->lock);
+        servo_set_target(sd, sd->cur_angle);
+        mutex_unlock(&sd->lock);
+        break;
+
+    case SERVO_IOCTL_SET_EVENTFD: {
+        struct servo_eventfd ef;
+        struct eventfd_ctx *ctx;
+        if (copy_from_user(&ef, (void __user *)arg, sizeof(ef)))
+            return -EFAULT;
+        /* the controller eventfd belongs to /dev/servo-ctl */
+        ctx = servo_eventfd_get(&ef, 0);
+        if (IS_ERR(ctx))
+            return PTR_ERR(ctx);
+        /* swap in the new context, drop the old one outside the lock */
+        mutex_lock(&sd->lock);
+        swap(sd->evfd, ctx);
+        sd->ev_mask = sd->evfd ? ef.mask : 0;
+        mutex_unlock(&sd->lock);
+        if (ctx)
+            eventfd_ctx_put(ctx);
+        break;
+    }
+
+    case SERVO_IOCTL_GET_EVENTS: {
+        u32 ev;
+        mutex_lock(&sd->lock);
+        ev = sd->ev_pending;
+        sd->ev_pending = 0;
+        mutex_unlock(&sd->lock);
+        if (copy_to_user((void __user *)arg, &ev, sizeof(ev)))
+            return -EFAULT;
+        break;
+    }
+
+    case SERVO_IOCTL_GET_PENDING:
+        return servo_get_pending((void __user *)arg);
+
+    case SERVO_IOCTL_RING_KICK:
+        servo_motion_kick(sd);
+        break;
+
+    case SERVO_IOCTL_STAGE: {
+        struct servo_stage sg;
+        if (copy_from_user(&sg, (void __user *)arg, sizeof(sg)))
+            return -EFAULT;
+        ret = servo_stage_check(&sg);
+        if (ret)
+            return ret;
+        mutex_lock(&sd->lock);
+        ret = servo_stage_fits(sd, &sg);
+        if (!ret)
+            servo_stage_add(sd, &sg);
+        mutex_unlock(&sd->lock);
+        break;
+    }
+
+    case SERVO_IOCTL_COMMIT:
+        servo_commit();
+        break;
+
+    case SERVO_IOCTL_SET_STREAM: {
+        struct servo_stream st;
+        if (copy_from_user(&st, (void __user *)arg, sizeof(st)))
+            return -EFAULT;
+        if (st.enable > 1 || st.horizon_ms > SERVO_STREAM_MAX_NS / NSEC_PER_MSEC)
+            return -EINVAL;
+        mutex_lock(&sd->lock);
+        sd->stream_horizon_ns = (s64)st.horizon_ms * NSEC_PER_MSEC;
+        sd->stream_dur_ns = servo_tick_ns(sd);
+        sd->stream_t0 = 0;
+        sd->stream_moving = false;
+        atomic64_set(&sd->sp_stamp, 0);
+        WRITE_ONCE(sd->stream_on, st.enable);
+        mutex_unlock(&sd->lock);
+        break;
     }
 
-    servo_apply_angle(sd, next_angle);
-
-out_resched_if_needed:
-    /* Keep ticking while enabled and not at target or speed>0 */
-    if (sd->enabled && (sd->speed_dps > 0) && (sd->cur_angle != sd->target_angle))
-        schedule_delayed_work(&sd->motion_work, msecs_to_jiffies(sd->tick_ms));
+    case SERVO_IOCTL_SET_PULSE_NS: {
+        u32 ns;
+        if (copy_from_user(&ns, (void __user *)arg, sizeof(ns)))
+            return -EFAULT;
+        mutex_lock(&sd->lock);
+        if (sd->vel_mode) {
+            mutex_unlock(&sd->lock);
+            return -EBUSY;
+        }
+        /* supersedes SET_ANGLEs still in the mailbox */
+        sd->sp_seen = atomic_read(&sd->sp_seq);
+        servo_set_pulse_target(sd, ns);
+        if (sd->stream_on) {
+            ktime_t now = ktime_get();
+            servo_stream_setpoint(sd, now, now);
+            servo_motion_kick(sd);
+        } else {
+            ret = servo_apply_raw(sd, sd->raw_pulse_ns);
+        }
+        mutex_unlock(&sd->lock);
+        break;
+    }
 
-    mutex_unlock(&sd->lock);
-}
+    case SERVO_IOCTL_GET_PULSE_NS: {
+        u32 ns;
+        mutex_lock(&sd->lock);
+        ns = sd->duty_ns;
+        mutex_unlock(&sd->lock);
+        if (copy_to_user((void __user *)arg, &ns, sizeof(ns)))
+            return -EFAULT;
+        break;
+    }
 
-/* ---------- Char device ---------- */
+    case SERVO_IOCTL_SET_ROTATION: {
+        struct servo_rotation r;
+        if (copy_from_user(&r, (void __user *)arg, sizeof(r)))
+            return -EFAULT;
+        mutex_lock(&sd->lock);
+        ret = servo_set_rotation(sd, &r);
+        mutex_unlock(&sd->lock);
+        break;
+    }
 
-static long servo_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
-{
-    struct servo_dev *sd = filp->private_data;
-    int val, ret = 0;
+    case SERVO_IOCTL_GET_ROTATION: {
+        struct servo_rotation r;
+        mutex_lock(&sd->lock);
+        r.mode = sd->vel_mode ? SERVO_MODE_VELOCITY : SERVO_MODE_POSITION;
+        r.neutral_ns = sd->vel_neutral_ns;
+        r.deadband_ns = sd->vel_deadband_ns;
+        r.ramp_pmps = sd->vel_ramp;
+        mutex_unlock(&sd->lock);
+        if (copy_to_user((void __user *)arg, &r, sizeof(r)))
+            return -EFAULT;
+        break;
+    }
 
-    switch (cmd) {
-    case SERVO_IOCTL_ENABLE:
+    case SERVO_IOCTL_SET_VELOCITY:
         if (copy_from_user(&val, (void __user *)arg, sizeof(int)))
             return -EFAULT;
         mutex_lock(&sd->lock);
-        if (val && !sd->enabled) {
-            ret = pwm_enable(sd->pwm);
-            if (!ret) {
-                sd->enabled = 1;
-                /* apply current angle immediately */
-                servo_apply_angle(sd, sd->cur_angle);
-                /* kick motion loop if speed>0 */
-                if (sd->speed_dps > 0)
-                    schedule_delayed_work(&sd->motion_work, 0);
-            }
-        } else if (!val && sd->enabled) {
-            cancel_delayed_work_sync(&sd->motion_work);
-            pwm_disable(sd->pwm);
-            sd->enabled = 0;
+        if (sd->vel_mode) {
+            sd->vel_target = clamp(val, -SERVO_VELOCITY_MAX, SERVO_VELOCITY_MAX);
+            if (sd->enabled)
+                servo_motion_kick(sd);
+        } else {
+            ret = -EBUSY;
         }
         mutex_unlock(&sd->lock);
         break;
 
-    case SERVO_IOCTL_SET_ANGLE:
-        if (copy_from_user(&val, (void __user *)arg, sizeof(int)))
+    case SERVO_IOCTL_SET_PROTOCOL: {
+        struct servo_protocol p;
+        if (copy_from_user(&p, (void __user *)arg, sizeof(p)))
             return -EFAULT;
         mutex_lock(&sd->lock);
-        if (val < sd->limits.min_angle) val = sd->limits.min_angle;
-        if (val > sd->limits.max_angle) val = sd->limits.max_angle;
-        sd->target_angle = val;
+        ret = servo_set_protocol(sd, &p);
+        mutex_unlock(&sd->lock);
+        break;
+    }
 
-        if (!sd->enabled) {
-            mutex_unlock(&sd->lock);
-            return 0;
-        }
+    case SERVO_IOCTL_GET_PROTOCOL: {
+        struct servo_protocol p;
+        mutex_lock(&sd->lock);
+        p.protocol = sd->protocol;
+        p.period_ns = sd->period_ns;
+        mutex_unlock(&sd->lock);
+        if (copy_to_user((void __user *)arg, &p, sizeof(p)))
+            return -EFAULT;
+        break;
+    }
 
-        if (sd->speed_dps == 0) {
-            ret = servo_apply_angle(sd, sd->target_angle);
-        } else {
-            /* start motion loop */
-            schedule_delayed_work(&sd->motion_work, 0);
-        }
+    case SERVO_IOCTL_SET_TIMING: {
+        struct servo_timing t;
+        if (copy_from_user(&t, (void __user *)arg, sizeof(t)))
+            return -EFAULT;
+        mutex_lock(&sd->lock);
+        ret = servo_set_timing(sd, &t);
+        mutex_unlock(&sd->lock);
+        break;
+    }
+
+    case SERVO_IOCTL_GET_TIMING: {
+        struct servo_timing t = {};
+        mutex_lock(&sd->lock);
+        t.period_ns = sd->period_ns;
+        t.tick_us = sd->tick_us;
+        t.tick_ns = servo_tick_ns(sd);
+        mutex_unlock(&sd->lock);
+        if (copy_to_user((void __user *)arg, &t, sizeof(t)))
+            return -EFAULT;
+        break;
+    }
+
+    case SERVO_IOCTL_GET_VELOCITY:
+        mutex_lock(&sd->lock);
+        val = sd->vel_cur;
         mutex_unlock(&sd->lock);
+        if (copy_to_user((void __user *)arg, &val, sizeof(int)))
+            return -EFAULT;
         break;
 
     case SERVO_IOCTL_GET_ANGLE:
@@ -174,12 +1576,18 @@ static long servo_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned l
     case SERVO_IOCTL_SET_SPEED:
         if (copy_from_user(&val, (void __user *)arg, sizeof(int)))
             return -EFAULT;
+        servo_set_speed(sd, val);
+        break;
+
+    case SERVO_IOCTL_GET_STATE: {
+        struct servo_state st;
         mutex_lock(&sd->lock);
-        sd->speed_dps = (val < 0) ? 0 : val;
-        if (sd->enabled && sd->speed_dps > 0 && sd->cur_angle != sd->target_angle)
-            schedule_delayed_work(&sd->motion_work, 0);
+        servo_get_state(sd, &st);
         mutex_unlock(&sd->lock);
+        if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+            return -EFAULT;
         break;
+    }
 
     case SERVO_IOCTL_GET_SPEED:
         mutex_lock(&sd->lock);
@@ -193,16 +1601,7 @@ static long servo_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned l
         struct servo_limits lims;
         if (copy_from_user(&lims, (void __user *)arg, sizeof(lims)))
             return -EFAULT;
-        if (lims.max_angle <= lims.min_angle)
-            return -EINVAL;
-        if (lims.max_pulse_ns <= lims.min_pulse_ns)
-            return -EINVAL;
-        mutex_lock(&sd->lock);
-        sd->limits = lims;
-        /* re-apply current */
-        if (sd->enabled)
-            ret = servo_apply_angle(sd, sd->cur_angle);
-        mutex_unlock(&sd->lock);
+        ret = servo_set_limits(sd, &lims);
         break;
     }
 
@@ -235,18 +1634,303 @@ static int servo_release(struct inode *inode, struct file *filp)
     return 0;
 }
 
+/* Map the submission ring (struct servo_ring) */
+static int servo_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct servo_dev *sd = filp->private_data;
+    int ret;
+
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_ALIGN(SERVO_RING_SIZE))
+        return -EINVAL;
+
+    mutex_lock(&sd->lock);
+    ret = servo_ring_alloc(sd);
+    mutex_unlock(&sd->lock);
+    if (ret)
+        return ret;
+
+    /* the ring lives until remove; the mapping holds its own page refs */
+    return remap_vmalloc_range(vma, sd->ring, 0);
+}
+
 static const struct file_operations servo_fops = {
     .owner          = THIS_MODULE,
     .open           = servo_open,
     .release        = servo_release,
+    .mmap           = servo_mmap,
     .unlocked_ioctl = servo_unlocked_ioctl,
 #ifdef CONFIG_COMPAT
     .compat_ioctl   = servo_unlocked_ioctl,
 #endif
 };
 
+/* ---------- Controller node ---------- */
+
+/* Snapshots of up to req->count servos, in servo_list order */
+static int servo_ctl_get_states(struct servo_states __user *ureq)
+{
+    struct servo_states req;
+    struct servo_state *st = NULL;
+    struct servo_dev *sd;
+    unsigned int n = 0, total = 0;
+    int ret = 0;
+
+    if (copy_from_user(&req, ureq, sizeof(req)))
+        return -EFAULT;
+    req.count = min_t(u32, req.count, SERVO_MAX_DEVICES);
+    if (req.count) {
+        st = kvmalloc_array(req.count, sizeof(*st), GFP_KERNEL);
+        if (!st)
+            return -ENOMEM;
+    }
+
+    mutex_lock(&servo_list_lock);
+    list_for_each_entry(sd, &servo_list, node) {
+        if (n < req.count) {
+            mutex_lock(&sd->lock);
+            servo_get_state(sd, &st[n++]);
+            mutex_unlock(&sd->lock);
+        }
+        total++;
+    }
+    mutex_unlock(&servo_list_lock);
+
+    if (n && copy_to_user(u64_to_user_ptr(req.states), st, n * sizeof(*st)))
+        ret = -EFAULT;
+    req.count = n;
+    req.total = total;
+    if (!ret && copy_to_user(ureq, &req, sizeof(req)))
+        ret = -EFAULT;
+    kvfree(st);
+    return ret;
+}
+
+static struct servo_dev *servo_find_locked(unsigned int id)
+{
+    struct servo_dev *sd;
+
+    list_for_each_entry(sd, &servo_list, node)
+        if (sd->id == id)
+            return sd;
+    return NULL;
+}
+
+/* STAGE on several servos, all or nothing, optionally followed by COMMIT */
+static int servo_ctl_stage_batch(struct servo_stage_batch __user *ureq)
+{
+    struct servo_stage_batch req;
+    struct servo_stage *sg;
+    struct servo_dev *sd;
+    unsigned int i;
+    int ret = 0;
+
+    if (copy_from_user(&req, ureq, sizeof(req)))
+        return -EFAULT;
+    if (!req.count || req.count > SERVO_MAX_DEVICES || (req.flags & ~SERVO_BATCH_COMMIT))
+        return -EINVAL;
+    sg = memdup_array_user(u64_to_user_ptr(req.stages), req.count, sizeof(*sg));
+    if (IS_ERR(sg))
+        return PTR_ERR(sg);
+    for (i = 0; i < req.count && !ret; i++)
+        ret = servo_stage_check(&sg[i]);
+    if (ret)
+        goto out;
+
+    mutex_lock(&servo_list_lock);
+    for (i = 0; i < req.count; i++) {
+        sd = servo_find_locked(sg[i].index);
+        if (!sd) {
+            ret = -ENODEV;
+            goto unlock;
+        }
+        mutex_lock(&sd->lock);
+        ret = servo_stage_fits(sd, &sg[i]);
+        mutex_unlock(&sd->lock);
+        if (ret)
+            goto unlock;
+    }
+    for (i = 0; i < req.count; i++) {
+        sd = servo_find_locked(sg[i].index);
+        mutex_lock(&sd->lock);
+        servo_stage_add(sd, &sg[i]);
+        mutex_unlock(&sd->lock);
+    }
+    if (req.flags & SERVO_BATCH_COMMIT)
+        servo_commit_locked();
+unlock:
+    mutex_unlock(&servo_list_lock);
+out:
+    kfree(sg);
+    return ret;
+}
+
+/* SET_EVENTFD with SERVO_EVENTFD_CONTROLLER: one eventfd for all servos */
+static int servo_ctl_set_eventfd(struct servo_eventfd __user *uef)
+{
+    struct servo_eventfd ef;
+    struct eventfd_ctx *ctx;
+
+    if (copy_from_user(&ef, uef, sizeof(ef)))
+        return -EFAULT;
+    ctx = servo_eventfd_get(&ef, SERVO_EVENTFD_CONTROLLER);
+    if (IS_ERR(ctx))
+        return PTR_ERR(ctx);
+    /* swap in the new context, drop the old one outside the lock */
+    spin_lock(&servo_ev_lock);
+    swap(servo_ctl_evfd, ctx);
+    WRITE_ONCE(servo_ctl_ev_mask, servo_ctl_evfd ? ef.mask : 0);
+    spin_unlock(&servo_ev_lock);
+    if (ctx)
+        eventfd_ctx_put(ctx);
+    return 0;
+}
+
+static long servo_ctl_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    switch (cmd) {
+    case SERVO_IOCTL_SET_EVENTFD:
+        return servo_ctl_set_eventfd((void __user *)arg);
+    case SERVO_IOCTL_GET_STATES:
+        return servo_ctl_get_states((void __user *)arg);
+    case SERVO_IOCTL_GET_PENDING:
+        return servo_get_pending((void __user *)arg);
+    case SERVO_IOCTL_ESTOP_ALL:
+        servo_estop_all();
+        return 0;
+    case SERVO_IOCTL_STAGE_BATCH:
+        return servo_ctl_stage_batch((void __user *)arg);
+    case SERVO_IOCTL_COMMIT:
+        servo_commit();
+        return 0;
+    }
+    return -ENOTTY;
+}
+
+static const struct file_operations servo_ctl_fops = {
+    .owner          = THIS_MODULE,
+    .unlocked_ioctl = servo_ctl_ioctl,
+#ifdef CONFIG_COMPAT
+    .compat_ioctl   = servo_ctl_ioctl,
+#endif
+};
+
+static struct miscdevice servo_ctl_dev = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name  = SERVO_CTL_NAME,
+    .fops  = &servo_ctl_fops,
+    .mode  = 0660,
+};
+
+/* ---------- debugfs ---------- */
+
+static int servo_stats_show(struct seq_file *s, void *unused)
+{
+    struct servo_dev *sd = s->private;
+
+    mutex_lock(&sd->pwm_lock);
+    seq_printf(s, "estop_count:   %llu\n", sd->estop_count);
+    seq_printf(s, "estop_last_ns: %llu\n", sd->estop_last_ns);
+    seq_printf(s, "estop_max_ns:  %llu\n", sd->estop_max_ns);
+    mutex_unlock(&sd->pwm_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(servo_stats);
+
 /* ---------- Platform driver ---------- */
 
+/* Locks, motion machinery and default parameters; no hardware access */
+static void servo_init_state(struct servo_dev *sd)
+{
+    mutex_init(&sd->lock);
+    mutex_init(&sd->pwm_lock);
+
+    /* Default-Parameter */
+    sd->period_ns = SERVO_DEFAULT_PERIOD_NS;
+    sd->limits.min_angle    = 0;
+    sd->limits.max_angle    = 180;
+    sd->limits.min_pulse_ns = SERVO_DEFAULT_MIN_NS;
+    sd->limits.max_pulse_ns = SERVO_DEFAULT_MAX_NS;
+    sd->cur_angle = 90;
+    sd->cur_mdeg = 90000;
+    sd->target_angle = 90;
+    atomic_set(&sd->sp_angle, 90);
+    atomic_set(&sd->sp_seq, 0);
+    sd->sp_seen = 0;
+    sd->speed_dps = 0;
+    sd->enabled = 0;
+    sd->tick_us = 20000; /* 50Hz update */
+
+    INIT_DELAYED_WORK(&sd->motion_work, servo_motion_tick);
+    hrtimer_init(&sd->timed_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    sd->timed_timer.function = servo_timed_fire;
+    hrtimer_init(&sd->tick_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    sd->tick_timer.function = servo_tick_fire;
+}
+
+/* Optional DT servo-protocol = "standard" | "oneshot125" | "oneshot42" | "multishot" */
+static int servo_parse_protocol(struct servo_dev *sd)
+{
+    struct servo_protocol p = {};
+    const char *name;
+    int ret;
+
+    if (device_property_read_string(sd->dev, "servo-protocol", &name))
+        return 0;
+
+    for (p.protocol = 0; p.protocol < ARRAY_SIZE(servo_protos); p.protocol++)
+        if (!strcmp(name, servo_protos[p.protocol].name))
+            break;
+
+    mutex_lock(&sd->lock);
+    ret = servo_set_protocol(sd, &p);
+    mutex_unlock(&sd->lock);
+    return ret;
+}
+
+/* Optional DT servo-period-ns and servo-tick-us, after servo-protocol */
+static int servo_parse_timing(struct servo_dev *sd)
+{
+    struct servo_timing t = {};
+    int ret;
+
+    device_property_read_u32(sd->dev, "servo-period-ns", &t.period_ns);
+    device_property_read_u32(sd->dev, "servo-tick-us", &t.tick_us);
+    if (!t.period_ns && !t.tick_us)
+        return 0;
+
+    mutex_lock(&sd->lock);
+    ret = servo_set_timing(sd, &t);
+    mutex_unlock(&sd->lock);
+    return ret;
+}
+
+/*
+ * Optional DT properties of a continuous-rotation servo:
+ *
+ *   continuous-rotation;             start in velocity mode
+ *   neutral-pulse-ns = <1500000>;    standstill, default mid of the limits
+ *   deadband-pulse-ns = <20000>;     +- around neutral without motion
+ *   velocity-ramp = <2000>;          permille of full speed per second
+ */
+static int servo_parse_rotation(struct servo_dev *sd)
+{
+    struct servo_rotation r = {};
+    int ret;
+
+    if (!device_property_read_bool(sd->dev, "continuous-rotation"))
+        return 0;
+
+    r.mode = SERVO_MODE_VELOCITY;
+    device_property_read_u32(sd->dev, "neutral-pulse-ns", &r.neutral_ns);
+    device_property_read_u32(sd->dev, "deadband-pulse-ns", &r.deadband_ns);
+    device_property_read_u32(sd->dev, "velocity-ramp", &r.ramp_pmps);
+
+    mutex_lock(&sd->lock);
+    ret = servo_set_rotation(sd, &r);
+    mutex_unlock(&sd->lock);
+    return ret;
+}
+
 static int servo_probe(struct platform_device *pdev)
 {
     struct servo_dev *sd;
@@ -257,7 +1941,6 @@ static int servo_probe(struct platform_device *pdev)
         return -ENOMEM;
 
     sd->dev = &pdev->dev;
-    mutex_init(&sd->lock);
 
     /* PWM handle aus DT: pwms = <&pwm 0 20000000>; period 20ms */
     sd->pwm = devm_pwm_get(&pdev->dev, "servo");
@@ -266,59 +1949,65 @@ static int servo_probe(struct platform_device *pdev)
         return PTR_ERR(sd->pwm);
     }
 
-    /* Default-Parameter */
-    sd->period_ns = SERVO_DEFAULT_PERIOD_NS;
-    sd->limits.min_angle    = 0;
-    sd->limits.max_angle    = 180;
-    sd->limits.min_pulse_ns = SERVO_DEFAULT_MIN_NS;
-    sd->limits.max_pulse_ns = SERVO_DEFAULT_MAX_NS;
-    sd->cur_angle = 90;
-    sd->target_angle = 90;
-    sd->speed_dps = 0;
-    sd->enabled = 0;
-    sd->tick_ms = 20; /* 50Hz update */
+    servo_init_state(sd);
 
-    INIT_DELAYED_WORK(&sd->motion_work, servo_motion_tick);
+    ret = servo_parse_protocol(sd);
+    if (ret) {
+        dev_err(&pdev->dev, "invalid servo-protocol\n");
+        return ret;
+    }
 
-    /* Vorkonfigurieren */
-    ret = pwm_config(sd->pwm,
-                     map_angle_to_pulse_ns(sd, sd->cur_angle),
-                     sd->period_ns);
-    if (ret)
+    ret = servo_parse_timing(sd);
+    if (ret) {
+        dev_err(&pdev->dev, "invalid servo-period-ns or servo-tick-us\n");
+        return ret;
+    }
+
+    ret = servo_parse_rotation(sd);
+    if (ret) {
+        dev_err(&pdev->dev, "invalid continuous-rotation properties\n");
         return ret;
+    }
 
-    /* Char device anlegen */
-    ret = alloc_chrdev_region(&sd->devt, 0, 1, SERVO_DEVICE_NAME);
+    /* Vorkonfigurieren (continuous rotation: standstill) */
+    ret = pwm_config(sd->pwm, servo_rest_pulse_ns(sd), sd->period_ns);
     if (ret)
         return ret;
 
+    /* Char device anlegen */
+    sd->id = ida_alloc_max(&servo_ida, SERVO_MAX_DEVICES - 1, GFP_KERNEL);
+    if (sd->id < 0)
+        return sd->id;
+    snprintf(sd->name, sizeof(sd->name), SERVO_DEVICE_NAME, sd->id);
+    sd->devt = MKDEV(MAJOR(servo_devt_base), sd->id);
+
     cdev_init(&sd->cdev, &servo_fops);
     ret = cdev_add(&sd->cdev, sd->devt, 1);
     if (ret)
-        goto err_unregister;
-
-    sd->cls = class_create(SERVO_CLASS_NAME);
-    if (IS_ERR(sd->cls)) {
-        ret = PTR_ERR(sd->cls);
-        goto err_cdev;
-    }
+        goto err_ida;
 
-    sd->cdev_dev = device_create(sd->cls, NULL, sd->devt, NULL, SERVO_DEVICE_NAME);
+    sd->cdev_dev = device_create(servo_class, &pdev->dev, sd->devt, sd, "%s", sd->name);
     if (IS_ERR(sd->cdev_dev)) {
         ret = PTR_ERR(sd->cdev_dev);
-        goto err_class;
+        goto err_cdev;
     }
 
     platform_set_drvdata(pdev, sd);
-    dev_info(&pdev->dev, "servo driver ready (/dev/%s)\n", SERVO_DEVICE_NAME);
+
+    sd->dbg = debugfs_create_dir(sd->name, servo_debugfs_root);
+    debugfs_create_file("stats", 0444, sd->dbg, sd, &servo_stats_fops);
+
+    mutex_lock(&servo_list_lock);
+    list_add_tail(&sd->node, &servo_list);
+    mutex_unlock(&servo_list_lock);
+
+    dev_info(&pdev->dev, "servo driver ready (/dev/%s)\n", sd->name);
     return 0;
 
-err_class:
-    class_destroy(sd->cls);
 err_cdev:
     cdev_del(&sd->cdev);
-err_unregister:
-    unregister_chrdev_region(sd->devt, 1);
+err_ida:
+    ida_free(&servo_ida, sd->id);
     return ret;
 }
 
@@ -326,14 +2015,32 @@ static int servo_remove(struct platform_device *pdev)
 {
     struct servo_dev *sd = platform_get_drvdata(pdev);
 
+    mutex_lock(&servo_list_lock);
+    list_del(&sd->node);
+    mutex_unlock(&servo_list_lock);
+
+    debugfs_remove_recursive(sd->dbg);
+
+    /* a tick after this does not re-arm tick_timer */
+    mutex_lock(&sd->lock);
+    sd->timed_count = 0;
+    set_bit(SERVO_F_DEAD, &sd->flags);
+    mutex_unlock(&sd->lock);
+    hrtimer_cancel(&sd->timed_timer);
+    hrtimer_cancel(&sd->tick_timer);
     cancel_delayed_work_sync(&sd->motion_work);
     if (sd->enabled)
         pwm_disable(sd->pwm);
+    kvfree(sd->traj);
+    vfree(sd->ring);
+    if (sd->evfd)
+        eventfd_ctx_put(sd->evfd);
 
-    device_destroy(sd->cls, sd->devt);
-    class_destroy(sd->cls);
+    device_destroy(servo_class, sd->devt);
     cdev_del(&sd->cdev);
-    unregister_chrdev_region(sd->devt, 1);
+    /* no stale GET_PENDING bit for the next servo with this id */
+    clear_bit(sd->id, servo_ev_pending);
+    ida_free(&servo_ida, sd->id);
 
     return 0;
 }
@@ -352,7 +2059,67 @@ static struct platform_driver servo_driver = {
         .of_match_table = servo_of_match,
     },
 };
-module_platform_driver(servo_driver);
+
+static int __init servo_init(void)
+{
+    int ret;
+
+    /* own high-priority queue: motion ticks must not wait behind system_wq */
+    servo_wq = alloc_workqueue("servo", WQ_HIGHPRI, 0);
+    if (!servo_wq)
+        return -ENOMEM;
+
+    ret = alloc_chrdev_region(&servo_devt_base, 0, SERVO_MAX_DEVICES, "servo");
+    if (ret)
+        goto err_wq;
+
+    servo_class = class_create(SERVO_CLASS_NAME);
+    if (IS_ERR(servo_class)) {
+        ret = PTR_ERR(servo_class);
+        goto err_region;
+    }
+
+    servo_debugfs_root = debugfs_create_dir("servo", NULL);
+
+    ret = platform_driver_register(&servo_driver);
+    if (ret)
+        goto err_class;
+
+    ret = misc_register(&servo_ctl_dev);
+    if (ret)
+        goto err_driver;
+    return 0;
+
+err_driver:
+    platform_driver_unregister(&servo_driver);
+err_class:
+    debugfs_remove_recursive(servo_debugfs_root);
+    class_destroy(servo_class);
+err_region:
+    unregister_chrdev_region(servo_devt_base, SERVO_MAX_DEVICES);
+err_wq:
+    destroy_workqueue(servo_wq);
+    return ret;
+}
+module_init(servo_init);
+
+static void __exit servo_exit(void)
+{
+    misc_deregister(&servo_ctl_dev);
+    platform_driver_unregister(&servo_driver);
+    if (servo_ctl_evfd)
+        eventfd_ctx_put(servo_ctl_evfd);
+    debugfs_remove_recursive(servo_debugfs_root);
+    class_destroy(servo_class);
+    unregister_chrdev_region(servo_devt_base, SERVO_MAX_DEVICES);
+    ida_destroy(&servo_ida);
+    destroy_workqueue(servo_wq);
+}
+module_exit(servo_exit);
+
+#ifdef SERVO_KUNIT_TEST
+#include "servo_kunit.c"
+#endif
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Remo");
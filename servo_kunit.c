@@ -0,0 +1,781 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit suite for servo.c, built into servo.ko with "make SERVO_KUNIT=y"
+ * (needs CONFIG_KUNIT). Included from servo.c so the static helpers are
+ * reachable. The PWM is replaced by a static stub and ticks are driven
+ * by hand with a fake clock; no hardware or workqueue is involved.
+ */
+#include <kunit/test.h>
+#include <kunit/test-bug.h>
+#include <kunit/static_stub.h>
+
+static unsigned int bench_budget_ns;
+module_param(bench_budget_ns, uint, 0644);
+MODULE_PARM_DESC(bench_budget_ns, "KUnit: fail the tick benchmark above this many ns per channel (0 = report only)");
+
+struct servo_test_ctx {
+    unsigned int applies;
+    unsigned int last_duty_ns;
+    int fail;                   /* returned by the PWM stub */
+};
+
+static int servo_test_apply_pulse(struct servo_dev *sd, unsigned int duty_ns)
+{
+    struct kunit *test = kunit_get_current_test();
+    struct servo_test_ctx *ctx = test->priv;
+
+    if (ctx->fail)
+        return ctx->fail;
+    ctx->applies++;
+    ctx->last_duty_ns = duty_ns;
+    return 0;
+}
+
+/* The trajectory buffer is allocated on the first TRAJ_LOAD */
+static void servo_test_free_traj(void *data)
+{
+    struct servo_dev *sd = data;
+
+    kvfree(sd->traj);
+}
+
+static struct servo_dev *servo_test_dev(struct kunit *test)
+{
+    struct servo_dev *sd = kunit_kzalloc(test, sizeof(*sd), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, sd);
+    /* runs before kunit frees sd, also when an assertion ends the test */
+    KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, servo_test_free_traj, sd), 0);
+    servo_init_state(sd);
+    /* the test drives the ticks; keep servo_motion_kick() from queueing work */
+    set_bit(SERVO_F_LOOP, &sd->flags);
+    sd->enabled = 1;
+    return sd;
+}
+
+static bool servo_test_tick(struct servo_dev *sd, s64 now_ns)
+{
+    bool busy;
+
+    mutex_lock(&sd->lock);
+    busy = servo_motion_step(sd, ns_to_ktime(now_ns));
+    mutex_unlock(&sd->lock);
+    return busy;
+}
+
+/* SET_ANGLE as seen by the tick, with a chosen publish time */
+static void servo_test_publish(struct servo_dev *sd, int angle, s64 stamp_ns)
+{
+    atomic64_set(&sd->sp_stamp, stamp_ns);
+    atomic_set(&sd->sp_angle, angle);
+    atomic_inc(&sd->sp_seq);
+}
+
+/*
+ * Controller-wide state the stage and event tests change through the
+ * fixtures (id 0); put back as found for the servos actually bound.
+ */
+static u32 servo_test_saved_ev_mask;
+static int servo_test_saved_commit_gen;
+static DECLARE_BITMAP(servo_test_saved_pending, SERVO_MAX_DEVICES);
+
+static int servo_test_suite_init(struct kunit_suite *suite)
+{
+    servo_test_saved_ev_mask = READ_ONCE(servo_ctl_ev_mask);
+    servo_test_saved_commit_gen = atomic_read(&servo_commit_gen);
+    bitmap_copy(servo_test_saved_pending, servo_ev_pending, SERVO_MAX_DEVICES);
+    return 0;
+}
+
+static void servo_test_suite_exit(struct kunit_suite *suite)
+{
+    WRITE_ONCE(servo_ctl_ev_mask, servo_test_saved_ev_mask);
+    atomic_set(&servo_commit_gen, servo_test_saved_commit_gen);
+    bitmap_copy(servo_ev_pending, servo_test_saved_pending, SERVO_MAX_DEVICES);
+}
+
+static int servo_test_init(struct kunit *test)
+{
+    test->priv = kunit_kzalloc(test, sizeof(struct servo_test_ctx), GFP_KERNEL);
+    if (!test->priv)
+        return -ENOMEM;
+    kunit_activate_static_stub(test, servo_apply_pulse, servo_test_apply_pulse);
+    return 0;
+}
+
+/* ---------- Mapping ---------- */
+
+static void servo_test_map_defaults(struct kunit *test)
+{
+    struct servo_dev *sd = servo_test_dev(test);
+
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, 0), 1000000U);
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, 90), 1500000U);
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, 180), 2000000U);
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, -10), 1000000U);
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, 400), 2000000U);
+    KUNIT_EXPECT_EQ(test, map_mdeg_to_pulse_ns(sd, 45500), 1252777U);
+}
+
+/* span * angle used to be computed in 32 bits */
+static void servo_test_map_overflow(struct kunit *test)
+{
+    struct servo_dev *sd = servo_test_dev(test);
+
+    sd->limits = (struct servo_limits){ 0, 360, 0, 20000000 };
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, 180), 10000000U);
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, 360), 20000000U);
+
+    sd->limits = (struct servo_limits){ INT_MIN, INT_MAX, 0, UINT_MAX };
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, INT_MIN), 0U);
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, 0), 1U << 31);
+    KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, INT_MAX), UINT_MAX);
+
+    /* the inverse: span * pulse overflows 64 bits here */
+    sd->limits = (struct servo_limits){ -2000000, 2000000, 0, UINT_MAX };
+    KUNIT_EXPECT_EQ(test, servo_core_pulse_mdeg(&sd->limits, 0), -2000000000);
+    KUNIT_EXPECT_EQ(test, servo_core_pulse_mdeg(&sd->limits, 1U << 31), 0);
+    KUNIT_EXPECT_EQ(test, servo_core_pulse_mdeg(&sd->limits, UINT_MAX), 2000000000);
+}
+
+/* Whole limit space: in range, monotonic, exact ends, mdeg path agrees */
+static void servo_test_map_sweep(struct kunit *test)
+{
+    static const int angles[][2] = {
+        { 0, 180 }, { -90, 90 }, { 0, 1 }, { 0, 3600 }, { INT_MIN, INT_MAX },
+    };
+    static const unsigned int pulses[][2] = {
+        { 1000000, 2000000 }, { 500000, 2500000 }, { 0, 1 }, { 0, UINT_MAX },
+    };
+    struct servo_dev *sd = servo_test_dev(test);
+    unsigned int a, p, ns, prev;
+    s64 angle, step;
+
+    for (a = 0; a < ARRAY_SIZE(angles); a++) {
+        for (p = 0; p < ARRAY_SIZE(pulses); p++) {
+            sd->limits = (struct servo_limits){ angles[a][0], angles[a][1],
+                                                pulses[p][0], pulses[p][1] };
+            KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, angles[a][0]), pulses[p][0]);
+            KUNIT_EXPECT_EQ(test, map_angle_to_pulse_ns(sd, angles[a][1]), pulses[p][1]);
+
+            step = max_t(s64, 1, ((s64)angles[a][1] - angles[a][0]) / 997);
+            prev = 0;
+            for (angle = angles[a][0]; angle <= angles[a][1]; angle += step) {
+                ns = map_angle_to_pulse_ns(sd, angle);
+                KUNIT_EXPECT_GE(test, ns, pulses[p][0]);
+                KUNIT_EXPECT_LE(test, ns, pulses[p][1]);
+                KUNIT_EXPECT_GE(test, ns, prev);
+                KUNIT_EXPECT_EQ(test, map_mdeg_to_pulse_ns(sd, angle * 1000), ns);
+                prev = ns;
+            }
+        }
+    }
+}
+
+/* ---------- Motion stepping ---------- */
+
+static void servo_test_step_speed(struct kunit *test)
+{
+    struct servo_test_ctx *ctx = test->priv;
+    struct servo_dev *sd = servo_test_dev(test);
+    s64 t = 0;
+    int i;
+
+    sd->speed_dps = 90;             /* 1.8 -> 2 degrees per 20 ms tick */
+    servo_test_publish(sd, 100, 0);
+
+    for (i = 1; i <= 4; i++) {
+        KUNIT_EXPECT_TRUE(test, servo_test_tick(sd, t += 20 * NSEC_PER_MSEC));
+        KUNIT_EXPECT_EQ(test, sd->cur_angle, 90 + 2 * i);
+    }
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, t += 20 * NSEC_PER_MSEC));
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 100);
+    KUNIT_EXPECT_EQ(test, ctx->applies, 5U);
+}
+
+/* Setpoints between two ticks collapse into one PWM update */
+static void servo_test_step_coalesce(struct kunit *test)
+{
+    struct servo_test_ctx *ctx = test->priv;
+    struct servo_dev *sd = servo_test_dev(test);
+
+    servo_test_publish(sd, 120, 0);
+    servo_test_publish(sd, 30, 0);
+    servo_test_publish(sd, 500, 0);  /* clamped to max_angle */
+
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, 0));
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 180);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 2000000U);
+    KUNIT_EXPECT_EQ(test, ctx->applies, 1U);
+
+    /* nothing new: no apply */
+    servo_test_tick(sd, 20 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, ctx->applies, 1U);
+}
+
+static void servo_test_step_disabled(struct kunit *test)
+{
+    struct servo_test_ctx *ctx = test->priv;
+    struct servo_dev *sd = servo_test_dev(test);
+
+    sd->enabled = 0;
+    servo_test_publish(sd, 10, 0);
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, 0));
+    KUNIT_EXPECT_EQ(test, sd->target_angle, 10);
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 90);
+
+    sd->enabled = 1;
+    set_bit(SERVO_F_ESTOP, &sd->flags);
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, 0));
+    KUNIT_EXPECT_EQ(test, ctx->applies, 0U);
+}
+
+/* ---------- SET_LIMITS / SET_SPEED ---------- */
+
+static void servo_test_limits(struct kunit *test)
+{
+    struct servo_dev *sd = servo_test_dev(test);
+    struct servo_limits bad_angle = { 90, 90, 1000000, 2000000 };
+    struct servo_limits bad_pulse = { 0, 180, 2000000, 1000000 };
+    struct servo_limits narrow = { 0, 60, 1000000, 2000000 };
+
+    KUNIT_EXPECT_EQ(test, servo_set_limits(sd, &bad_angle), -EINVAL);
+    KUNIT_EXPECT_EQ(test, servo_set_limits(sd, &bad_pulse), -EINVAL);
+
+    /* moving to 170 when the range shrinks to 0..60 */
+    sd->speed_dps = 10;
+    servo_test_publish(sd, 170, 0);
+    servo_test_tick(sd, 0);
+    KUNIT_EXPECT_EQ(test, servo_set_limits(sd, &narrow), 0);
+    KUNIT_EXPECT_EQ(test, sd->target_angle, 60);
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 60);
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, 20 * NSEC_PER_MSEC));
+}
+
+static void servo_test_speed(struct kunit *test)
+{
+    struct servo_dev *sd = servo_test_dev(test);
+
+    servo_set_speed(sd, -5);
+    KUNIT_EXPECT_EQ(test, sd->speed_dps, 0);
+
+    /* slow move, then speed 0 finishes it on the next tick */
+    servo_set_speed(sd, 50);
+    servo_test_publish(sd, 0, 0);
+    KUNIT_EXPECT_TRUE(test, servo_test_tick(sd, 0));
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 89);
+    servo_set_speed(sd, 0);
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, 20 * NSEC_PER_MSEC));
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 0);
+}
+
+/* ---------- Trajectory / streaming ---------- */
+
+static void servo_test_traj(struct kunit *test)
+{
+    struct servo_knot k[] = {
+        { .t_ms = 0,    .angle_mdeg = 0 },
+        { .t_ms = 500,  .angle_mdeg = 45000 },
+        { .t_ms = 1000, .angle_mdeg = 90000 },
+    };
+    struct servo_traj tr = { .count = ARRAY_SIZE(k), .start_ns = NSEC_PER_SEC };
+    struct servo_dev *sd = servo_test_dev(test);
+    int prev, ms;
+
+    mutex_lock(&sd->lock);
+    KUNIT_ASSERT_EQ(test, servo_traj_load(sd, &tr, k), 0);
+    mutex_unlock(&sd->lock);
+
+    /* u = 0.5 on [0, 500]: m0 = 0, m1 = 90 deg/s (Catmull-Rom) */
+    servo_test_tick(sd, NSEC_PER_SEC + 250 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->cur_mdeg, 16875);
+
+    /* C1: no jumps, bounded per-ms change across the knot at 500 ms */
+    prev = sd->cur_mdeg;
+    for (ms = 251; ms < 1000; ms++) {
+        KUNIT_EXPECT_TRUE(test, servo_test_tick(sd, NSEC_PER_SEC + ms * NSEC_PER_MSEC));
+        KUNIT_EXPECT_LE(test, abs(sd->cur_mdeg - prev), 140);
+        prev = sd->cur_mdeg;
+    }
+
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, 2 * NSEC_PER_SEC));
+    KUNIT_EXPECT_EQ(test, sd->cur_mdeg, 90000);
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 90);
+}
+
+/* Knots outside the limits: target and output stay inside them */
+static void servo_test_traj_limits(struct kunit *test)
+{
+    struct servo_knot k[] = {
+        { .t_ms = 0,    .angle_mdeg = 90000 },
+        { .t_ms = 500,  .angle_mdeg = 200000 },
+        { .t_ms = 1000, .angle_mdeg = -20000 },
+    };
+    struct servo_traj tr = { .count = ARRAY_SIZE(k), .start_ns = NSEC_PER_SEC };
+    struct servo_dev *sd = servo_test_dev(test);
+    int ms;
+
+    mutex_lock(&sd->lock);
+    KUNIT_ASSERT_EQ(test, servo_traj_load(sd, &tr, k), 0);
+    mutex_unlock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, sd->target_angle, 0);
+
+    for (ms = 0; ms < 1000; ms += 10) {
+        servo_test_tick(sd, NSEC_PER_SEC + ms * NSEC_PER_MSEC);
+        KUNIT_EXPECT_GE(test, sd->cur_mdeg, 0);
+        KUNIT_EXPECT_LE(test, sd->cur_mdeg, 180000);
+        if (ms == 500)
+            KUNIT_EXPECT_EQ(test, sd->cur_mdeg, 180000);
+    }
+
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, 2 * NSEC_PER_SEC));
+    KUNIT_EXPECT_EQ(test, sd->cur_mdeg, 0);
+}
+
+static void servo_test_stream(struct kunit *test)
+{
+    struct servo_dev *sd = servo_test_dev(test);
+    s64 t0 = NSEC_PER_SEC;
+
+    sd->stream_on = true;
+    sd->stream_horizon_ns = 100 * NSEC_PER_MSEC;
+    sd->stream_dur_ns = 20 * NSEC_PER_MSEC;
+
+    servo_test_publish(sd, 100, t0);
+    servo_test_tick(sd, t0 + 10 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->cur_mdeg, 95000);
+    servo_test_tick(sd, t0 + 20 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->cur_mdeg, 100000);
+
+    /* stalled: extrapolate, then hold at the horizon */
+    KUNIT_EXPECT_TRUE(test, servo_test_tick(sd, t0 + 40 * NSEC_PER_MSEC));
+    KUNIT_EXPECT_EQ(test, sd->cur_mdeg, 110000);
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, t0 + 500 * NSEC_PER_MSEC));
+    KUNIT_EXPECT_EQ(test, sd->cur_mdeg, 150000);
+
+    /* a due SET_ANGLE_AT starts a segment like SET_ANGLE */
+    sd->timed[0] = (struct servo_timed_cmd){ .deadline = ns_to_ktime(t0 + 510 * NSEC_PER_MSEC),
+                                             .op = SERVO_TIMED_ANGLE, .value = 140 };
+    sd->timed_count = 1;
+    KUNIT_EXPECT_TRUE(test, servo_test_tick(sd, t0 + 520 * NSEC_PER_MSEC));
+    KUNIT_EXPECT_EQ(test, sd->timed_count, 0U);
+    KUNIT_EXPECT_TRUE(test, sd->stream_moving);
+    servo_test_tick(sd, t0 + 540 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_NE(test, sd->cur_mdeg, 150000);
+}
+
+/* ---------- State snapshot ---------- */
+
+static void servo_test_state(struct kunit *test)
+{
+    struct servo_dev *sd = servo_test_dev(test);
+    struct servo_state st;
+
+    sd->speed_dps = 100;
+    servo_test_publish(sd, 100, 0);
+    servo_test_tick(sd, 0);
+
+    mutex_lock(&sd->lock);
+    servo_get_state(sd, &st);
+    mutex_unlock(&sd->lock);
+
+    KUNIT_EXPECT_EQ(test, st.flags, SERVO_STATE_ENABLED | SERVO_STATE_MOVING);
+    KUNIT_EXPECT_EQ(test, st.cur_angle, 92);
+    KUNIT_EXPECT_EQ(test, st.target_angle, 100);
+    KUNIT_EXPECT_EQ(test, st.speed_dps, 100);
+    KUNIT_EXPECT_EQ(test, st.limits.max_pulse_ns, SERVO_DEFAULT_MAX_NS);
+    KUNIT_EXPECT_EQ(test, st.reserved[0], 0U);
+}
+
+/* ---------- Submission ring ---------- */
+
+static void servo_test_ring(struct kunit *test)
+{
+    struct servo_dev *sd = servo_test_dev(test);
+    struct servo_ring *r;
+    s64 t = 0;
+    unsigned int i;
+
+    KUNIT_ASSERT_EQ(test, servo_ring_alloc(sd), 0);
+    r = sd->ring;
+
+    /* a burst between two ticks: in order, last angle wins */
+    r->entries[0] = (struct servo_ring_entry){ SERVO_RING_OP_SPEED, 0 };
+    r->entries[1] = (struct servo_ring_entry){ SERVO_RING_OP_ANGLE, 10 };
+    r->entries[2] = (struct servo_ring_entry){ SERVO_RING_OP_ANGLE, 120 };
+    smp_store_release(&r->tail, 3);
+    KUNIT_EXPECT_TRUE(test, servo_test_tick(sd, t));
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 120);
+    KUNIT_EXPECT_EQ(test, r->head, 3U);
+
+    /* keeps polling the ring for a while, then may idle */
+    for (i = 1; i < SERVO_RING_IDLE_TICKS; i++)
+        KUNIT_EXPECT_TRUE(test, servo_test_tick(sd, t += 20 * NSEC_PER_MSEC));
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, t += 20 * NSEC_PER_MSEC));
+
+    /* a producer two rings ahead: only the last ring's worth is used */
+    for (i = 0; i < SERVO_RING_ENTRIES; i++)
+        r->entries[i] = (struct servo_ring_entry){ SERVO_RING_OP_ANGLE, 45 };
+    smp_store_release(&r->tail, 3 + 2 * SERVO_RING_ENTRIES);
+    servo_test_tick(sd, t += 20 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 45);
+    KUNIT_EXPECT_EQ(test, r->head, 3U + 2 * SERVO_RING_ENTRIES);
+
+    vfree(sd->ring);
+}
+
+/* ---------- Raw pulse ---------- */
+
+static void servo_test_pulse(struct kunit *test)
+{
+    struct servo_test_ctx *ctx = test->priv;
+    struct servo_dev *sd = servo_test_dev(test);
+
+    /* exact width, angle follows for reporting */
+    mutex_lock(&sd->lock);
+    servo_set_pulse_target(sd, 1234567);
+    KUNIT_EXPECT_EQ(test, servo_apply_raw(sd, sd->raw_pulse_ns), 0);
+    mutex_unlock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 1234567U);
+    KUNIT_EXPECT_EQ(test, sd->cur_mdeg, 42222);
+    KUNIT_EXPECT_EQ(test, sd->target_angle, sd->cur_angle);
+
+    /* the loop keeps it, the speed limit does not apply */
+    sd->speed_dps = 10;
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, 0));
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 1234567U);
+
+    /* clamped to the pulse limits, also when they change */
+    mutex_lock(&sd->lock);
+    servo_set_pulse_target(sd, 5000000);
+    KUNIT_EXPECT_EQ(test, sd->raw_pulse_ns, SERVO_DEFAULT_MAX_NS);
+    sd->limits.max_pulse_ns = 1900000;
+    servo_limits_changed(sd);
+    mutex_unlock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 1900000U);
+
+    /* an angle setpoint returns to angle mode */
+    sd->speed_dps = 0;
+    servo_test_publish(sd, 90, 0);
+    servo_test_tick(sd, 20 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->raw_pulse_ns, 0U);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 1450000U);
+}
+
+/* ---------- Continuous rotation ---------- */
+
+static void servo_test_velocity(struct kunit *test)
+{
+    struct servo_test_ctx *ctx = test->priv;
+    struct servo_dev *sd = servo_test_dev(test);
+    struct servo_rotation r = {
+        .mode = SERVO_MODE_VELOCITY, .neutral_ns = 1500000,
+        .deadband_ns = 50000, .ramp_pmps = 1000,
+    };
+    struct servo_limits lims;
+    struct servo_stage sg;
+    s64 t = 0;
+    int i;
+
+    /* deadband must leave room on both sides */
+    mutex_lock(&sd->lock);
+    r.deadband_ns = 500000;
+    KUNIT_EXPECT_EQ(test, servo_set_rotation(sd, &r), -EINVAL);
+    r.deadband_ns = 50000;
+    KUNIT_EXPECT_EQ(test, servo_set_rotation(sd, &r), 0);
+    mutex_unlock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 1500000U);
+
+    /* ramped at 1000 permille/s: 20 per 20 ms tick, past the deadband */
+    sd->vel_target = 100;
+    KUNIT_EXPECT_TRUE(test, servo_test_tick(sd, t));
+    KUNIT_EXPECT_EQ(test, sd->vel_cur, 20);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 1559000U);
+    for (i = 0; i < 4; i++)
+        servo_test_tick(sd, t += 20 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->vel_cur, 100);
+    KUNIT_EXPECT_FALSE(test, servo_test_tick(sd, t += 20 * NSEC_PER_MSEC));
+
+    /* full reverse, position setpoints have no say */
+    sd->vel_target = -SERVO_VELOCITY_MAX;
+    servo_test_publish(sd, 10, 0);
+    while (servo_test_tick(sd, t += 20 * NSEC_PER_MSEC))
+        ;
+    KUNIT_EXPECT_EQ(test, sd->vel_cur, -SERVO_VELOCITY_MAX);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, SERVO_DEFAULT_MIN_NS);
+
+    /* nor staged ones: refused on STAGE, lapsed if the mode changed since */
+    sg = (struct servo_stage){ .mask = SERVO_STAGE_PULSE, .pulse_ns = 1200000 };
+    mutex_lock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, servo_stage_fits(sd, &sg), -EBUSY);
+    servo_stage_add(sd, &sg);
+    mutex_unlock(&sd->lock);
+    servo_commit();
+    servo_test_tick(sd, t += 20 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->raw_pulse_ns, 0U);
+
+    /* limits that leave the standstill outside reset the calibration */
+    lims = (struct servo_limits){ 0, 180, 500000, 1400000 };
+    KUNIT_EXPECT_EQ(test, servo_set_limits(sd, &lims), 0);
+    KUNIT_EXPECT_EQ(test, sd->vel_neutral_ns, 0U);
+    KUNIT_EXPECT_EQ(test, sd->vel_deadband_ns, 0U);
+    sd->vel_target = sd->vel_cur = 0;
+    mutex_lock(&sd->lock);
+    servo_apply_velocity(sd, 0);
+    mutex_unlock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 950000U);
+}
+
+/* ---------- Protocols ---------- */
+
+static void servo_test_protocol(struct kunit *test)
+{
+    struct servo_test_ctx *ctx = test->priv;
+    struct servo_dev *sd = servo_test_dev(test);
+    struct servo_protocol p = { .protocol = SERVO_PROTO_ONESHOT125 };
+    struct servo_limits lims;
+    struct servo_stage sg;
+
+    /* own pulse range, period tightened to it */
+    mutex_lock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, servo_set_protocol(sd, &p), 0);
+    mutex_unlock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, sd->period_ns, 312500U);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 187500U);
+
+    /* limits must leave a gap before the next frame */
+    lims = sd->limits;
+    lims.max_pulse_ns = 400000;
+    KUNIT_EXPECT_EQ(test, servo_set_limits(sd, &lims), -EINVAL);
+
+    /* 333 Hz standard: period only shorter than a frame, limits back to 1..2 ms */
+    mutex_lock(&sd->lock);
+    p = (struct servo_protocol){ SERVO_PROTO_STANDARD, 2000000 };
+    KUNIT_EXPECT_EQ(test, servo_set_protocol(sd, &p), -EINVAL);
+    p.period_ns = 3003003;
+    KUNIT_EXPECT_EQ(test, servo_set_protocol(sd, &p), 0);
+    mutex_unlock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, sd->limits.max_pulse_ns, SERVO_DEFAULT_MAX_NS);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, 1500000U);
+
+    /* staged limits: checked on STAGE and again once committed */
+    sg = (struct servo_stage){ .mask = SERVO_STAGE_LIMITS,
+                               .limits = { 0, 180, 1000000, 3500000 } };
+    mutex_lock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, servo_stage_fits(sd, &sg), -EINVAL);
+    sg.limits.max_pulse_ns = 2500000;
+    KUNIT_EXPECT_EQ(test, servo_stage_fits(sd, &sg), 0);
+    servo_stage_add(sd, &sg);
+    p.period_ns = 2200000;
+    KUNIT_EXPECT_EQ(test, servo_set_protocol(sd, &p), 0);
+    mutex_unlock(&sd->lock);
+    servo_commit();
+    servo_test_tick(sd, 0);
+    KUNIT_EXPECT_EQ(test, sd->stage.mask, 0U);
+    KUNIT_EXPECT_EQ(test, sd->limits.max_pulse_ns, SERVO_DEFAULT_MAX_NS);
+    KUNIT_EXPECT_TRUE(test, sd->ev_pending & SERVO_EV_PWM_FAULT);
+}
+
+/* ---------- Frame-aligned ticks ---------- */
+
+static void servo_test_tick_align(struct kunit *test)
+{
+    struct servo_dev *sd = servo_test_dev(test);
+    const s64 ms = NSEC_PER_MSEC, us = NSEC_PER_USEC;
+
+    tick_margin_us = 200;
+    sd->frame_t0 = ns_to_ktime(1 * ms);
+
+    /* kicked mid-frame: margin before the boundary a tick later */
+    KUNIT_EXPECT_EQ(test, ktime_to_ns(servo_next_tick(sd, ns_to_ktime(6 * ms))),
+                    21 * ms - 200 * us);
+    /* late tick stays on its own frame, no frame skipped */
+    KUNIT_EXPECT_EQ(test, ktime_to_ns(servo_next_tick(sd, ns_to_ktime(21 * ms - 150 * us))),
+                    41 * ms - 200 * us);
+    KUNIT_EXPECT_EQ(test, ktime_to_ns(servo_next_tick(sd, ns_to_ktime(21 * ms + 3 * ms))),
+                    41 * ms - 200 * us);
+
+    /* 333 Hz: 20 ms rounds to 7 frames */
+    sd->period_ns = 3000000;
+    sd->frame_t0 = 0;
+    KUNIT_EXPECT_EQ(test, ktime_to_ns(servo_next_tick(sd, ns_to_ktime(3 * ms - 200 * us))),
+                    24 * ms - 200 * us);
+}
+
+static void servo_test_timing(struct kunit *test)
+{
+    struct servo_test_ctx *ctx = test->priv;
+    struct servo_dev *sd = servo_test_dev(test);
+    struct servo_timing t = { .period_ns = 2500000, .tick_us = 2500 };
+    s64 now = 0;
+
+    /* 400 Hz digital servo ticked every frame: 400 dps is 1 degree a tick */
+    mutex_lock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, servo_set_timing(sd, &t), 0);
+    mutex_unlock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, servo_tick_ns(sd), 2500000LL);
+    sd->speed_dps = 400;
+    servo_test_publish(sd, 92, 0);
+    KUNIT_EXPECT_TRUE(test, servo_test_tick(sd, now += 2500 * NSEC_PER_USEC));
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 91);
+
+    /* tick below the range refused, period left alone */
+    mutex_lock(&sd->lock);
+    t = (struct servo_timing){ .period_ns = 20000000, .tick_us = 100 };
+    KUNIT_EXPECT_EQ(test, servo_set_timing(sd, &t), -EINVAL);
+    KUNIT_EXPECT_EQ(test, sd->period_ns, 2500000U);
+
+    /* a disabled output still checks the period with the chip */
+    sd->enabled = 0;
+    ctx->fail = -EINVAL;
+    t = (struct servo_timing){ .period_ns = 20000000 };
+    KUNIT_EXPECT_EQ(test, servo_set_timing(sd, &t), -EINVAL);
+    KUNIT_EXPECT_EQ(test, sd->period_ns, 2500000U);
+    ctx->fail = 0;
+    KUNIT_EXPECT_EQ(test, servo_set_timing(sd, &t), 0);
+    mutex_unlock(&sd->lock);
+    KUNIT_EXPECT_EQ(test, ctx->last_duty_ns, map_angle_to_pulse_ns(sd, 91));
+    /* 2.5 ms rounds to one 20 ms frame */
+    KUNIT_EXPECT_EQ(test, servo_tick_ns(sd), 20000000LL);
+}
+
+/* ---------- Staged commit ---------- */
+
+static void servo_test_stage(struct kunit *test)
+{
+    struct servo_dev *sd = servo_test_dev(test);
+    struct servo_stage sg = { .mask = SERVO_STAGE_ANGLE | SERVO_STAGE_SPEED, .angle = 120 };
+
+    /* staged: no effect until committed */
+    servo_stage_add(sd, &sg);
+    servo_test_tick(sd, 0);
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 90);
+
+    servo_commit();
+    servo_test_tick(sd, 20 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 120);
+    KUNIT_EXPECT_EQ(test, sd->stage.mask, 0U);
+
+    /* a STAGE between COMMIT and the tick waits for the next commit */
+    sg = (struct servo_stage){ .mask = SERVO_STAGE_ANGLE, .angle = 30 };
+    servo_stage_add(sd, &sg);
+    servo_commit();
+    sg.angle = 60;
+    servo_stage_add(sd, &sg);
+    servo_test_tick(sd, 40 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 30);
+    servo_commit();
+    servo_test_tick(sd, 60 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->cur_angle, 60);
+}
+
+/* ---------- Events ---------- */
+
+static void servo_test_events(struct kunit *test)
+{
+    struct servo_test_ctx *ctx = test->priv;
+    struct servo_dev *sd = servo_test_dev(test);
+
+    WRITE_ONCE(servo_ctl_ev_mask, SERVO_EV_TARGET_REACHED);
+
+    /* speed-limited move: reached only on the last step */
+    sd->speed_dps = 100;
+    servo_test_publish(sd, 94, 0);
+    servo_test_tick(sd, 0);
+    KUNIT_EXPECT_EQ(test, sd->ev_pending, 0U);
+    servo_test_tick(sd, 20 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->ev_pending, SERVO_EV_TARGET_REACHED);
+    KUNIT_EXPECT_TRUE(test, test_and_clear_bit(sd->id, servo_ev_pending));
+
+    /* PWM failure: reported, not in the controller mask */
+    sd->ev_pending = 0;
+    ctx->fail = -EIO;
+    servo_test_publish(sd, 10, 0);
+    servo_test_tick(sd, 40 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, sd->ev_pending, SERVO_EV_PWM_FAULT);
+    KUNIT_EXPECT_FALSE(test, test_bit(sd->id, servo_ev_pending));
+
+    WRITE_ONCE(servo_ctl_ev_mask, 0);
+}
+
+/* ---------- Per-tick cost ---------- */
+
+static const unsigned int servo_bench_channels[] = { 1, 16, 256 };
+
+static void servo_bench_desc(const unsigned int *n, char *desc)
+{
+    snprintf(desc, KUNIT_PARAM_DESC_SIZE, "%u channels", *n);
+}
+KUNIT_ARRAY_PARAM(servo_bench, servo_bench_channels, servo_bench_desc);
+
+#define SERVO_BENCH_TICKS  (256 * 1024)
+
+static void servo_test_bench_tick(struct kunit *test)
+{
+    unsigned int n = *(const unsigned int *)test->param_value;
+    unsigned int rounds = SERVO_BENCH_TICKS / n, r, i;
+    struct servo_dev **sds;
+    s64 t = 0, ns;
+    ktime_t t0;
+
+    sds = kunit_kcalloc(test, n, sizeof(*sds), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, sds);
+    for (i = 0; i < n; i++) {
+        sds[i] = servo_test_dev(test);
+        sds[i]->speed_dps = 500;
+        sds[i]->target_angle = 180;
+    }
+
+    t0 = ktime_get();
+    for (r = 0; r < rounds; r++) {
+        t += 20 * NSEC_PER_MSEC;
+        for (i = 0; i < n; i++) {
+            struct servo_dev *sd = sds[i];
+
+            mutex_lock(&sd->lock);
+            if (!servo_motion_step(sd, ns_to_ktime(t)))
+                sd->target_angle = sd->target_angle ? 0 : 180; /* sweep back */
+            mutex_unlock(&sd->lock);
+        }
+    }
+    ns = div_s64(ktime_to_ns(ktime_sub(ktime_get(), t0)), rounds * n);
+
+    kunit_info(test, "%u channels: %lld ns per channel tick\n", n, ns);
+    if (bench_budget_ns)
+        KUNIT_EXPECT_LE(test, ns, (s64)bench_budget_ns);
+}
+
+static struct kunit_case servo_test_cases[] = {
+    KUNIT_CASE(servo_test_map_defaults),
+    KUNIT_CASE(servo_test_map_overflow),
+    KUNIT_CASE(servo_test_map_sweep),
+    KUNIT_CASE(servo_test_step_speed),
+    KUNIT_CASE(servo_test_step_coalesce),
+    KUNIT_CASE(servo_test_step_disabled),
+    KUNIT_CASE(servo_test_limits),
+    KUNIT_CASE(servo_test_speed),
+    KUNIT_CASE(servo_test_traj),
+    KUNIT_CASE(servo_test_traj_limits),
+    KUNIT_CASE(servo_test_stream),
+    KUNIT_CASE(servo_test_state),
+    KUNIT_CASE(servo_test_ring),
+    KUNIT_CASE(servo_test_pulse),
+    KUNIT_CASE(servo_test_velocity),
+    KUNIT_CASE(servo_test_protocol),
+    KUNIT_CASE(servo_test_tick_align),
+    KUNIT_CASE(servo_test_timing),
+    KUNIT_CASE(servo_test_stage),
+    KUNIT_CASE(servo_test_events),
+    KUNIT_CASE_PARAM_ATTR(servo_test_bench_tick, servo_bench_gen_params,
+                          { .speed = KUNIT_SPEED_SLOW }),
+    {}
+};
+
+static struct kunit_suite servo_test_suite = {
+    .name       = "servo",
+    .suite_init = servo_test_suite_init,
+    .suite_exit = servo_test_suite_exit,
+    .init       = servo_test_init,
+    .test_cases = servo_test_cases,
+};
+kunit_test_suite(servo_test_suite);
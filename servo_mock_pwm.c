@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Software PWM chip for testing and benchmarking the servo driver without
+ * hardware. Registers a pwm_chip with 'nchannels' channels and one
+ * "remo_servo" platform device per channel, wired up through a PWM lookup
+ * table, so loading this module next to servo.ko yields /dev/servo0..N-1.
+ *
+ * Every applied state is logged with a ktime stamp into a ring that is
+ * read from debugfs servo-mock-pwm/log (one line per apply, oldest first):
+ *
+ *   <seq> <ktime_ns> <channel> <enabled> <duty_ns> <period_ns>
+ *
+ * Writing anything to the log file clears it. apply_delay_us simulates a
+ * slow PWM backend (e.g. an I2C expander).
+ */
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/pwm.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#define MOCK_PWM_NAME       "servo-mock-pwm"
+#define MOCK_PWM_MAX_CH     256
+#define MOCK_LOG_SIZE       4096    /* entries, power of two */
+
+static unsigned int nchannels = 4;
+module_param(nchannels, uint, 0444);
+MODULE_PARM_DESC(nchannels, "number of PWM channels / servo devices (1..256)");
+
+static unsigned int apply_delay_us;
+module_param(apply_delay_us, uint, 0644);
+MODULE_PARM_DESC(apply_delay_us, "simulated latency of every PWM apply");
+
+struct mock_log_entry {
+    u64             seq;
+    u64             ts_ns;
+    u32             channel;
+    u32             enabled;
+    u64             duty_ns;
+    u64             period_ns;
+};
+
+struct mock_pwm {
+    struct pwm_chip          chip;
+    struct platform_device  *pdev;
+    struct platform_device **servos;
+    struct pwm_lookup       *lookup;
+    struct dentry           *dbg;
+
+    spinlock_t               log_lock;
+    struct mock_log_entry   *log;
+    u64                      log_seq;   /* entries ever written */
+    u64                      log_first; /* oldest seq still readable */
+};
+
+static struct mock_pwm *mock;
+
+static int mock_pwm_apply(struct pwm_chip *chip, struct pwm_device *pwm,
+                          const struct pwm_state *state)
+{
+    struct mock_pwm *mp = container_of(chip, struct mock_pwm, chip);
+    struct mock_log_entry *e;
+    unsigned int delay = READ_ONCE(apply_delay_us);
+    unsigned long flags;
+
+    if (delay)
+        fsleep(delay);
+
+    spin_lock_irqsave(&mp->log_lock, flags);
+    e = &mp->log[mp->log_seq % MOCK_LOG_SIZE];
+    e->seq       = mp->log_seq;
+    e->ts_ns     = ktime_get_ns();
+    e->channel   = pwm->hwpwm;
+    e->enabled   = state->enabled;
+    e->duty_ns   = state->duty_cycle;
+    e->period_ns = state->period;
+    mp->log_seq++;
+    if (mp->log_seq - mp->log_first > MOCK_LOG_SIZE)
+        mp->log_first = mp->log_seq - MOCK_LOG_SIZE;
+    spin_unlock_irqrestore(&mp->log_lock, flags);
+
+    return 0;
+}
+
+static const struct pwm_ops mock_pwm_ops = {
+    .apply = mock_pwm_apply,
+};
+
+/* ---------- debugfs ---------- */
+
+static int mock_log_show(struct seq_file *s, void *unused)
+{
+    struct mock_pwm *mp = s->private;
+    struct mock_log_entry e;
+    unsigned long flags;
+    u64 seq, end;
+
+    spin_lock_irqsave(&mp->log_lock, flags);
+    seq = mp->log_first;
+    end = mp->log_seq;
+    spin_unlock_irqrestore(&mp->log_lock, flags);
+
+    for (; seq < end; seq++) {
+        spin_lock_irqsave(&mp->log_lock, flags);
+        if (seq < mp->log_first) {
+            /* overwritten while we were printing */
+            spin_unlock_irqrestore(&mp->log_lock, flags);
+            continue;
+        }
+        e = mp->log[seq % MOCK_LOG_SIZE];
+        spin_unlock_irqrestore(&mp->log_lock, flags);
+
+        seq_printf(s, "%llu %llu %u %u %llu %llu\n", e.seq, e.ts_ns,
+                   e.channel, e.enabled, e.duty_ns, e.period_ns);
+    }
+    return 0;
+}
+
+static int mock_log_open(struct inode *inode, struct file *file)
+{
+    return single_open_size(file, mock_log_show, inode->i_private,
+                            MOCK_LOG_SIZE * 64);
+}
+
+static ssize_t mock_log_write(struct file *file, const char __user *buf,
+                              size_t len, loff_t *ppos)
+{
+    struct mock_pwm *mp = ((struct seq_file *)file->private_data)->private;
+    unsigned long flags;
+
+    spin_lock_irqsave(&mp->log_lock, flags);
+    mp->log_first = mp->log_seq;
+    spin_unlock_irqrestore(&mp->log_lock, flags);
+    return len;
+}
+
+static const struct file_operations mock_log_fops = {
+    .owner   = THIS_MODULE,
+    .open    = mock_log_open,
+    .read    = seq_read,
+    .write   = mock_log_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/* ---------- Module ---------- */
+
+static void mock_unregister_servos(struct mock_pwm *mp, unsigned int n)
+{
+    while (n--)
+        platform_device_unregister(mp->servos[n]);
+}
+
+static int __init mock_pwm_init(void)
+{
+    struct mock_pwm *mp;
+    unsigned int i;
+    int ret;
+
+    if (!nchannels || nchannels > MOCK_PWM_MAX_CH)
+        return -EINVAL;
+
+    mp = kzalloc(sizeof(*mp), GFP_KERNEL);
+    if (!mp)
+        return -ENOMEM;
+    spin_lock_init(&mp->log_lock);
+
+    mp->log = kvcalloc(MOCK_LOG_SIZE, sizeof(*mp->log), GFP_KERNEL);
+    mp->servos = kcalloc(nchannels, sizeof(*mp->servos), GFP_KERNEL);
+    mp->lookup = kcalloc(nchannels, sizeof(*mp->lookup), GFP_KERNEL);
+    if (!mp->log || !mp->servos || !mp->lookup) {
+        ret = -ENOMEM;
+        goto err_free;
+    }
+
+    /* provider device; the lookup table matches on its name */
+    mp->pdev = platform_device_register_simple(MOCK_PWM_NAME, PLATFORM_DEVID_NONE, NULL, 0);
+    if (IS_ERR(mp->pdev)) {
+        ret = PTR_ERR(mp->pdev);
+        goto err_free;
+    }
+
+    mp->chip.dev  = &mp->pdev->dev;
+    mp->chip.ops  = &mock_pwm_ops;
+    mp->chip.npwm = nchannels;
+    ret = pwmchip_add(&mp->chip);
+    if (ret)
+        goto err_pdev;
+
+    /* channel i -> consumer "remo_servo.i", con_id "servo" as in servo_probe() */
+    for (i = 0; i < nchannels; i++) {
+        const char *dev_id = kasprintf(GFP_KERNEL, "remo_servo.%u", i);
+
+        if (!dev_id) {
+            ret = -ENOMEM;
+            goto err_lookup_names;
+        }
+        mp->lookup[i] = (struct pwm_lookup)PWM_LOOKUP(MOCK_PWM_NAME, i, dev_id, "servo",
+                                                      20000000, PWM_POLARITY_NORMAL);
+    }
+    pwm_add_table(mp->lookup, nchannels);
+
+    for (i = 0; i < nchannels; i++) {
+        mp->servos[i] = platform_device_register_simple("remo_servo", i, NULL, 0);
+        if (IS_ERR(mp->servos[i])) {
+            ret = PTR_ERR(mp->servos[i]);
+            goto err_servos;
+        }
+    }
+
+    mp->dbg = debugfs_create_dir(MOCK_PWM_NAME, NULL);
+    debugfs_create_file("log", 0644, mp->dbg, mp, &mock_log_fops);
+
+    mock = mp;
+    pr_info(MOCK_PWM_NAME ": %u channels\n", nchannels);
+    return 0;
+
+err_servos:
+    mock_unregister_servos(mp, i);
+    pwm_remove_table(mp->lookup, nchannels);
+    i = nchannels;
+err_lookup_names:
+    while (i--)
+        kfree(mp->lookup[i].dev_id);
+    pwmchip_remove(&mp->chip);
+err_pdev:
+    platform_device_unregister(mp->pdev);
+err_free:
+    kfree(mp->lookup);
+    kfree(mp->servos);
+    kvfree(mp->log);
+    kfree(mp);
+    return ret;
+}
+module_init(mock_pwm_init);
+
+static void __exit mock_pwm_exit(void)
+{
+    struct mock_pwm *mp = mock;
+    unsigned int i;
+
+    debugfs_remove_recursive(mp->dbg);
+    mock_unregister_servos(mp, nchannels);
+    pwm_remove_table(mp->lookup, nchannels);
+    for (i = 0; i < nchannels; i++)
+        kfree(mp->lookup[i].dev_id);
+    pwmchip_remove(&mp->chip);
+    platform_device_unregister(mp->pdev);
+    kfree(mp->lookup);
+    kfree(mp->servos);
+    kvfree(mp->log);
+    kfree(mp);
+}
+module_exit(mock_pwm_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Remo");
+MODULE_DESCRIPTION("Mock PWM chip for servo driver tests");
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Tracepoints of the servo driver, e.g. for tools/servojitter:
+ *
+ *   echo 1 > /sys/kernel/tracing/events/servo/servo_tick/enable
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM servo
+
+#if !defined(_SERVO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _SERVO_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * One motion tick: now_ns when it ran, due_ns when the re-queued tick was
+ * meant to run (0 for the first tick after the loop was kicked).
+ */
+TRACE_EVENT(servo_tick,
+    TP_PROTO(unsigned int id, s64 now_ns, s64 due_ns, int angle_mdeg),
+    TP_ARGS(id, now_ns, due_ns, angle_mdeg),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, id)
+        __field(s64,          now_ns)
+        __field(s64,          due_ns)
+        __field(int,          angle_mdeg)
+    ),
+
+    TP_fast_assign(
+        __entry->id         = id;
+        __entry->now_ns     = now_ns;
+        __entry->due_ns     = due_ns;
+        __entry->angle_mdeg = angle_mdeg;
+    ),
+
+    TP_printk("id=%u now=%lld due=%lld mdeg=%d",
+              __entry->id, __entry->now_ns, __entry->due_ns, __entry->angle_mdeg)
+);
+
+#endif /* _SERVO_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE servo_trace
+#include <trace/define_trace.h>
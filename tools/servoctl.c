@@ -5,9 +5,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <glob.h>
 
 #include "servo_uapi.h"
 
+#define SERVO_MAX_STATES 256    /* matches SERVO_MAX_DEVICES of the driver */
+
 static void usage(const char *prog) {
     fprintf(stderr,
         "Usage:\n"
@@ -22,16 +30,61 @@ static void usage(const char *prog) {
         "  step-      : -step degrees (default 10°, min 0)\n"
         "  set-limits <min_us> <max_us> : set pulse limits in microseconds (e.g. 500 2500)\n"
         "  get-limits : read current limits\n"
+        "  pulse <ns> : raw pulse width in ns, bypassing the angle mapping\n"
+        "  rotation position|velocity [NEUTRAL_NS [DEADBAND_NS [RAMP]]]\n"
+        "             : position or continuous-rotation mode; RAMP in permille/s\n"
+        "  velocity <v> : continuous rotation at v permille of full speed (-1000..1000)\n"
+        "  protocol standard|oneshot125|oneshot42|multishot [PERIOD_NS]\n"
+        "             : output protocol; PERIOD_NS e.g. 3003003 for a 333 Hz servo\n"
+        "  timing [PERIOD_NS [TICK_US]]\n"
+        "             : PWM frame period and control tick, 0 keeps a value\n"
+        "               (e.g. 3003003 3003 for one update per 333 Hz frame)\n"
+        "  state      : one consistent snapshot of the servo state\n"
+        "  states     : snapshots of all servos of the controller in one call\n"
+        "               (/dev/" SERVO_CTL_NAME ", ignores --device)\n"
+        "  estop      : emergency stop (PWM off until re-enabled)\n"
+        "  estop-all  : emergency stop for every servo of the controller\n"
         "  <number>   : set exact angle 0..180 (e.g. 73)\n"
+        "  bench [-t THREADS] [-n OPS] [-p PATTERN] [DEV...]\n"
+        "             : ioctl throughput/latency for 1..THREADS threads (default 8),\n"
+        "               OPS per thread (default 100000), PATTERN a comma list of\n"
+        "               set,get,speed cycled per thread (default set,get);\n"
+        "               threads are spread over DEV... (default --device)\n"
+        "  play [-p PATTERN] [-m traj|at|sleep] FILE\n"
+        "             : play keyframes 't_ms,channel,angle' (CSV) or a binary show\n"
+        "               file on the devices PATTERN (default /dev/servo%%u);\n"
+        "               streams kernel trajectories, falls back to SET_ANGLE_AT\n"
+        "               or clock_nanosleep + one STAGE_BATCH commit per timestamp\n"
+        "               (/dev/" SERVO_CTL_NAME "; SET_ANGLE per frame without it)\n"
+        "  shell      : read commands from stdin, one per line, on one open device;\n"
+        "               only state changes reach the driver, each line reports its\n"
+        "               time ('help' lists the shell commands)\n"
         "\n"
         "Options:\n"
-        "  --device DEV  (default: /dev/servo0)\n"
+        "  --device DEV  (default: /dev/servo0); repeat it, give a comma list or a\n"
+        "                quoted glob ('/dev/servo*') to run the command on all of\n"
+        "                them in parallel; absolute moves then go out as one\n"
+        "                commit through /dev/" SERVO_CTL_NAME " if the driver has it\n"
         "  --speed N     degrees per second (default: 90, 0 = immediate)\n"
         "  --step N      step size for step+/step- (default: 10)\n",
         prog
     );
 }
 
+static const char *const proto_names[] = {
+    [SERVO_PROTO_STANDARD]   = "standard",
+    [SERVO_PROTO_ONESHOT125] = "oneshot125",
+    [SERVO_PROTO_ONESHOT42]  = "oneshot42",
+    [SERVO_PROTO_MULTISHOT]  = "multishot",
+};
+
+static int proto_parse(const char *name) {
+    for (int i = 0; i < (int)(sizeof(proto_names) / sizeof(proto_names[0])); i++)
+        if (!strcmp(name, proto_names[i]))
+            return i;
+    return -1;
+}
+
 static int clamp(int v, int lo, int hi) {
     if (v < lo) return lo;
     if (v > hi) return hi;
@@ -47,24 +100,1104 @@ static int open_dev(const char *dev) {
     return fd;
 }
 
-static void print_limits(const struct servo_limits *L) {
-    printf("Limits: angle [%d..%d], pulse [%u..%u] ns (%.3f..%.3f ms)\n",
-           L->min_angle, L->max_angle,
-           L->min_pulse_ns, L->max_pulse_ns,
-           L->min_pulse_ns/1000000.0, L->max_pulse_ns/1000000.0);
+static void limits_str(char *buf, size_t len, const struct servo_limits *L) {
+    snprintf(buf, len, "Limits: angle [%d..%d], pulse [%u..%u] ns (%.3f..%.3f ms)",
+             L->min_angle, L->max_angle,
+             L->min_pulse_ns, L->max_pulse_ns,
+             L->min_pulse_ns/1000000.0, L->max_pulse_ns/1000000.0);
+}
+
+/* Angle for toNN/step+/step-/<number> relative to angle, or -1 */
+static int parse_target(const char *cmd, int angle, int step) {
+    char *endp = NULL;
+    long v;
+
+    if (!strcmp(cmd, "to45"))  return 45;
+    if (!strcmp(cmd, "to90"))  return 90;
+    if (!strcmp(cmd, "to135")) return 135;
+    if (!strcmp(cmd, "to180")) return 180;
+    if (!strcmp(cmd, "step+")) return clamp(angle + step, 0, 180);
+    if (!strcmp(cmd, "step-")) return clamp(angle - step, 0, 180);
+
+    /* numeric angle */
+    v = strtol(cmd, &endp, 10);
+    if (endp != cmd && *endp == '\0')
+        return clamp((int)v, 0, 180);
+    return -1;
+}
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ---------- bench ---------- */
+
+#define BENCH_MAX_DEVS   256
+#define BENCH_MAX_PAT    32
+
+enum bench_op { OP_SET, OP_GET, OP_SPEED };
+
+struct bench_cfg {
+    int              fds[BENCH_MAX_DEVS];
+    int              ndevs;
+    enum bench_op    pat[BENCH_MAX_PAT];
+    int              npat;
+    long             ops;
+    int              speed;
+    pthread_barrier_t start;
+};
+
+struct bench_thread {
+    pthread_t          tid;
+    struct bench_cfg  *cfg;
+    int                idx;
+    uint64_t          *lat_ns;  /* cfg->ops entries */
+    long               errors;
+};
+
+static void *bench_worker(void *arg) {
+    struct bench_thread *bt = arg;
+    struct bench_cfg *cfg = bt->cfg;
+    int fd = cfg->fds[bt->idx % cfg->ndevs];
+    int val, ret = 0;
+
+    pthread_barrier_wait(&cfg->start);
+
+    for (long i = 0; i < cfg->ops; i++) {
+        uint64_t t0 = mono_ns();
+        switch (cfg->pat[i % cfg->npat]) {
+        case OP_SET:
+            val = (i & 1) ? 100 : 80;
+            ret = ioctl(fd, SERVO_IOCTL_SET_ANGLE, &val);
+            break;
+        case OP_GET:
+            ret = ioctl(fd, SERVO_IOCTL_GET_ANGLE, &val);
+            break;
+        case OP_SPEED:
+            val = cfg->speed;
+            ret = ioctl(fd, SERVO_IOCTL_SET_SPEED, &val);
+            break;
+        }
+        bt->lat_ns[i] = mono_ns() - t0;
+        if (ret < 0)
+            bt->errors++;
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct_us(const uint64_t *sorted, size_t n, double p) {
+    size_t i = (size_t)(p * (n - 1));
+    return sorted[i] / 1000.0;
+}
+
+/* One run with nthreads threads; returns ops/s, or < 0 on error */
+static double bench_run(struct bench_cfg *cfg, int nthreads) {
+    struct bench_thread *bt = calloc(nthreads, sizeof(*bt));
+    size_t total = (size_t)nthreads * cfg->ops;
+    uint64_t *all = malloc(total * sizeof(*all));
+    uint64_t t0, el;
+    long errors = 0;
+    double ops_s = -1;
+    int i;
+
+    if (!bt || !all)
+        goto out;
+
+    pthread_barrier_init(&cfg->start, NULL, nthreads + 1);
+    for (i = 0; i < nthreads; i++) {
+        bt[i].cfg = cfg;
+        bt[i].idx = i;
+        bt[i].lat_ns = all + (size_t)i * cfg->ops;
+        if (pthread_create(&bt[i].tid, NULL, bench_worker, &bt[i])) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&cfg->start);
+    t0 = mono_ns();
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(bt[i].tid, NULL);
+        errors += bt[i].errors;
+    }
+    el = mono_ns() - t0;
+    pthread_barrier_destroy(&cfg->start);
+
+    qsort(all, total, sizeof(*all), cmp_u64);
+    ops_s = total / (el / 1e9);
+    printf("%7d %12.0f %9.2f %9.2f %9.2f", nthreads, ops_s,
+           pct_us(all, total, 0.50), pct_us(all, total, 0.99), pct_us(all, total, 0.999));
+    if (errors)
+        printf("  (%ld errors)", errors);
+
+out:
+    free(all);
+    free(bt);
+    return ops_s;
+}
+
+static int cmd_bench(const char *def_dev, int speed, int argc, char **argv) {
+    static struct bench_cfg cfg;
+    const char *pattern = "set,get";
+    int max_threads = 8, en = 1;
+    double base = 0, ops_s;
+    char buf[256], *tok, *save;
+
+    cfg.ops = 100000;
+    cfg.speed = speed;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            max_threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            cfg.ops = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            pattern = argv[++i];
+        } else if (cfg.ndevs < BENCH_MAX_DEVS) {
+            if ((cfg.fds[cfg.ndevs] = open_dev(argv[i])) < 0)
+                return 1;
+            cfg.ndevs++;
+        }
+    }
+    if (max_threads < 1 || cfg.ops < 1) {
+        fprintf(stderr, "bench: need THREADS >= 1 and OPS >= 1\n");
+        return 2;
+    }
+    if (!cfg.ndevs) {
+        if ((cfg.fds[0] = open_dev(def_dev)) < 0)
+            return 1;
+        cfg.ndevs = 1;
+    }
+
+    snprintf(buf, sizeof(buf), "%s", pattern);
+    for (tok = strtok_r(buf, ",", &save); tok && cfg.npat < BENCH_MAX_PAT;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (!strcmp(tok, "set"))        cfg.pat[cfg.npat++] = OP_SET;
+        else if (!strcmp(tok, "get"))   cfg.pat[cfg.npat++] = OP_GET;
+        else if (!strcmp(tok, "speed")) cfg.pat[cfg.npat++] = OP_SPEED;
+        else {
+            fprintf(stderr, "bench: unknown op '%s' (set, get, speed)\n", tok);
+            return 2;
+        }
+    }
+    if (!cfg.npat) {
+        fprintf(stderr, "bench: empty pattern\n");
+        return 2;
+    }
+
+    for (int d = 0; d < cfg.ndevs; d++) {
+        if (ioctl(cfg.fds[d], SERVO_IOCTL_ENABLE, &en) < 0 ||
+            ioctl(cfg.fds[d], SERVO_IOCTL_SET_SPEED, &speed) < 0) {
+            perror("bench setup");
+            return 1;
+        }
+    }
+
+    printf("bench: pattern %s, %ld ops/thread, %d device(s)\n", pattern, cfg.ops, cfg.ndevs);
+    printf("%7s %12s %9s %9s %9s  %s\n", "threads", "ops/s", "p50[us]", "p99[us]", "p999[us]", "scaling");
+
+    /* 1, 2, 4, ... and max_threads itself */
+    for (int n = 1; ; n = (n * 2 > max_threads && n < max_threads) ? max_threads : n * 2) {
+        ops_s = bench_run(&cfg, n);
+        if (ops_s < 0) {
+            fprintf(stderr, "bench: out of memory\n");
+            return 1;
+        }
+        if (n == 1)
+            base = ops_s;
+        printf("  %6.1f%%\n", 100.0 * ops_s / (n * base));
+        if (n >= max_threads)
+            break;
+    }
+
+    for (int d = 0; d < cfg.ndevs; d++)
+        close(cfg.fds[d]);
+    return 0;
+}
+
+/* ---------- shell ---------- */
+
+#define UNKNOWN  (-1)
+
+/* What this process last told the driver; UNKNOWN forces the next ioctl */
+struct shell_state {
+    int   fd;
+    int   enabled;
+    int   speed;
+    int   target;
+    int   want_speed;   /* --speed, applied before the first move */
+    int   step;
+};
+
+static void shell_help(void) {
+    printf("  <angle> | toNN | step+ | step-   move (enables the output if needed)\n"
+           "  speed N      set speed in deg/s (0 = immediate)\n"
+           "  enable | disable\n"
+           "  get          print the current angle\n"
+           "  limits       print the limits\n"
+           "  wait [MS]    poll until the last target is reached (timeout, default 10000)\n"
+           "  sleep MS     pause the script\n"
+           "  estop        emergency stop\n"
+           "  quit\n");
+}
+
+static int shell_enable(struct shell_state *st, int en) {
+    if (st->enabled == en)
+        return 0;
+    if (ioctl(st->fd, SERVO_IOCTL_ENABLE, &en) < 0)
+        return -1;
+    st->enabled = en;
+    return 0;
+}
+
+static int shell_speed(struct shell_state *st, int speed) {
+    if (speed < 0)
+        speed = 0;
+    if (st->speed == speed)
+        return 0;
+    if (ioctl(st->fd, SERVO_IOCTL_SET_SPEED, &speed) < 0)
+        return -1;
+    st->speed = speed;
+    return 0;
+}
+
+static int shell_move(struct shell_state *st, int target) {
+    if (shell_enable(st, 1) < 0 ||
+        shell_speed(st, st->speed == UNKNOWN ? st->want_speed : st->speed) < 0)
+        return -1;
+    if (st->target == target)
+        return 0;
+    if (ioctl(st->fd, SERVO_IOCTL_SET_ANGLE, &target) < 0)
+        return -1;
+    st->target = target;
+    return 0;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+/* Run one line; returns 1 to quit, 0 otherwise. Prints one line w/o newline. */
+static int shell_exec(struct shell_state *st, char *line) {
+    char *cmd = strtok(line, " \t\r\n");
+    char *arg = strtok(NULL, " \t\r\n");
+    int v, ret = 0;
+
+    if (!cmd || cmd[0] == '#')
+        return 0;
+
+    if (!strcmp(cmd, "quit") || !strcmp(cmd, "exit"))
+        return 1;
+
+    if (!strcmp(cmd, "speed") && arg) {
+        ret = shell_speed(st, atoi(arg));
+        if (!ret) printf("speed %d", st->speed);
+    } else if (!strcmp(cmd, "enable") || !strcmp(cmd, "disable")) {
+        ret = shell_enable(st, !strcmp(cmd, "enable"));
+        if (!ret) printf("%s", cmd);
+    } else if (!strcmp(cmd, "get")) {
+        ret = ioctl(st->fd, SERVO_IOCTL_GET_ANGLE, &v);
+        if (!ret) printf("angle %d", v);
+    } else if (!strcmp(cmd, "limits")) {
+        struct servo_limits L;
+        ret = ioctl(st->fd, SERVO_IOCTL_GET_LIMITS, &L);
+        if (!ret) printf("angle %d..%d pulse %u..%u ns", L.min_angle, L.max_angle,
+                         L.min_pulse_ns, L.max_pulse_ns);
+    } else if (!strcmp(cmd, "wait")) {
+        long timeout = arg ? atol(arg) : 10000, t = 0;
+        if (st->target == UNKNOWN) {
+            printf("nothing to wait for");
+            return 0;
+        }
+        while (!(ret = ioctl(st->fd, SERVO_IOCTL_GET_ANGLE, &v)) && v != st->target && t < timeout) {
+            sleep_ms(1);
+            t++;
+        }
+        if (!ret) printf("%s %d", v == st->target ? "at" : "timeout at", v);
+    } else if (!strcmp(cmd, "sleep") && arg) {
+        sleep_ms(atol(arg));
+        printf("slept");
+    } else if (!strcmp(cmd, "estop")) {
+        ret = ioctl(st->fd, SERVO_IOCTL_ESTOP, 0);
+        /* the driver disabled the output and dropped the target */
+        st->enabled = 0;
+        st->target = UNKNOWN;
+        if (!ret) printf("E-STOP");
+    } else {
+        int angle = st->target;
+
+        if ((!strcmp(cmd, "step+") || !strcmp(cmd, "step-")) &&
+            ioctl(st->fd, SERVO_IOCTL_GET_ANGLE, &angle) < 0)
+            angle = 0;
+        v = parse_target(cmd, angle, st->step);
+        if (v < 0) {
+            printf("unknown command '%s'", cmd);
+            return 0;
+        }
+        ret = shell_move(st, v);
+        if (!ret) printf("target %d", v);
+    }
+
+    if (ret < 0)
+        printf("error: %s", strerror(errno));
+    return 0;
+}
+
+static int cmd_shell(int fd, int speed, int step) {
+    struct shell_state st = {
+        .fd = fd, .enabled = UNKNOWN, .speed = UNKNOWN, .target = UNKNOWN,
+        .want_speed = speed, .step = step,
+    };
+    int tty = isatty(STDIN_FILENO);
+    char line[256];
+
+    /* answers must reach a reading pipeline line by line */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    for (;;) {
+        uint64_t t0;
+        int quit;
+
+        if (tty) {
+            printf("servo> ");
+            fflush(stdout);
+        }
+        if (!fgets(line, sizeof(line), stdin))
+            break;
+        if (!line[strspn(line, " \t\r\n")] || line[strspn(line, " \t")] == '#')
+            continue;
+
+        if (!strncmp(line + strspn(line, " \t"), "help", 4) &&
+            strchr(" \t\r\n", line[strspn(line, " \t") + 4])) {
+            shell_help();
+            continue;
+        }
+
+        t0 = mono_ns();
+        quit = shell_exec(&st, line);
+        if (quit)
+            break;
+        printf(" (%.1f us)\n", (mono_ns() - t0) / 1e3);
+    }
+    close(fd);
+    return 0;
+}
+
+/* ---------- play ---------- */
+
+/*
+ * Binary show file: header followed by count frames in time order, native
+ * endianness. mmap'd as is, so hours-long shows load without copying.
+ */
+#define SHOW_MAGIC     "SRVS"
+#define SHOW_VERSION   1
+#define PLAY_MAX_CH    256
+#define PLAY_CHUNK     256     /* knots per TRAJ_LOAD */
+#define PLAY_LEAD_MS   100     /* start delay, time to prime the trajectories */
+#define PLAY_AHEAD_MS  50      /* SET_ANGLE_AT issued this early */
+
+struct show_hdr {
+    char      magic[4];
+    uint32_t  version;
+    uint32_t  count;
+    uint32_t  reserved;
+};
+
+struct show_frame {
+    uint32_t  t_ms;
+    uint16_t  channel;
+    uint16_t  flags;      /* 0 */
+    int32_t   angle_mdeg;
+};
+
+enum play_mode { PLAY_TRAJ, PLAY_AT, PLAY_SLEEP };
+
+struct show {
+    const struct show_frame *f;
+    size_t                   count;
+    void                    *map;      /* binary file mapping, or NULL */
+    size_t                   map_len;
+    struct show_frame       *owned;    /* parsed CSV */
+};
+
+static int show_load_csv(struct show *sh, FILE *fp, const char *path) {
+    size_t cap = 0;
+    char line[256];
+    int lineno = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long t, ch;
+        double deg;
+
+        lineno++;
+        if (line[strspn(line, " \t")] == '#' || !line[strspn(line, " \t\r\n")])
+            continue;
+        if (sscanf(line, "%lu , %lu , %lf", &t, &ch, &deg) != 3) {
+            if (lineno == 1)
+                continue;   /* header row */
+            fprintf(stderr, "%s:%d: expected 't_ms,channel,angle'\n", path, lineno);
+            return -1;
+        }
+        if (ch >= PLAY_MAX_CH || t > UINT32_MAX || deg < -2e6 || deg > 2e6) {
+            fprintf(stderr, "%s:%d: value out of range\n", path, lineno);
+            return -1;
+        }
+        if (sh->count == cap) {
+            /* on failure the old buffer stays in sh->owned for the caller to free */
+            struct show_frame *grown;
+
+            cap = cap ? 2 * cap : 4096;
+            grown = realloc(sh->owned, cap * sizeof(*sh->owned));
+            if (!grown) {
+                fprintf(stderr, "out of memory\n");
+                return -1;
+            }
+            sh->owned = grown;
+        }
+        sh->owned[sh->count++] = (struct show_frame){
+            .t_ms = t, .channel = ch,
+            .angle_mdeg = (int32_t)(deg * 1000 + (deg < 0 ? -0.5 : 0.5)),
+        };
+    }
+    sh->f = sh->owned;
+    return 0;
+}
+
+static int show_load(struct show *sh, const char *path) {
+    struct show_hdr hdr;
+    struct stat stb;
+    uint32_t last_t[PLAY_MAX_CH];
+    uint8_t seen[PLAY_MAX_CH] = { 0 };
+    FILE *fp = fopen(path, "r");
+    int ret = -1;
+
+    if (!fp) {
+        fprintf(stderr, "open(%s) failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) == 1 && !memcmp(hdr.magic, SHOW_MAGIC, 4)) {
+        if (hdr.version != SHOW_VERSION || fstat(fileno(fp), &stb) < 0 ||
+            (uint64_t)stb.st_size < sizeof(hdr) + (uint64_t)hdr.count * sizeof(struct show_frame)) {
+            fprintf(stderr, "%s: bad or truncated show file\n", path);
+            goto out;
+        }
+        sh->map_len = stb.st_size;
+        sh->map = mmap(NULL, sh->map_len, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+        if (sh->map == MAP_FAILED) {
+            sh->map = NULL;
+            perror("mmap");
+            goto out;
+        }
+        madvise(sh->map, sh->map_len, MADV_SEQUENTIAL);
+        sh->f = (const struct show_frame *)((const char *)sh->map + sizeof(hdr));
+        sh->count = hdr.count;
+    } else {
+        rewind(fp);
+        if (show_load_csv(sh, fp, path) < 0)
+            goto out;
+    }
+
+    /* global time order, strictly increasing per channel (knot rule) */
+    for (size_t i = 0; i < sh->count; i++) {
+        const struct show_frame *f = &sh->f[i];
+
+        if (f->channel >= PLAY_MAX_CH || f->flags ||
+            (i && f->t_ms < sh->f[i - 1].t_ms) ||
+            (seen[f->channel] && f->t_ms <= last_t[f->channel])) {
+            fprintf(stderr, "%s: frame %zu out of order or invalid\n", path, i);
+            goto out;
+        }
+        seen[f->channel] = 1;
+        last_t[f->channel] = f->t_ms;
+    }
+    ret = 0;
+out:
+    fclose(fp);
+    return ret;
+}
+
+static void show_free(struct show *sh) {
+    if (sh->map)
+        munmap(sh->map, sh->map_len);
+    free(sh->owned);
+}
+
+static void sleep_until(uint64_t t_ns) {
+    struct timespec ts = { t_ns / 1000000000ULL, t_ns % 1000000000ULL };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+/*
+ * Kernel trajectories: one spline per channel, all sharing start_ns, kept
+ * topped up with APPEND as the ring drains. Each channel scans the shared
+ * frame array with its own cursor.
+ */
+static int play_traj(const struct show *sh, const int *fds, uint64_t start) {
+    static struct servo_knot k[PLAY_CHUNK];
+    size_t cur[PLAY_MAX_CH] = { 0 };
+    int loaded[PLAY_MAX_CH] = { 0 }, done;
+
+    do {
+        int progress = 0;
+
+        done = 1;
+        for (int ch = 0; ch < PLAY_MAX_CH; ch++) {
+            struct servo_traj tr = { .knots = (uintptr_t)k, .start_ns = start };
+            size_t i = cur[ch];
+
+            if (fds[ch] < 0)
+                continue;
+            while (i < sh->count && tr.count < PLAY_CHUNK) {
+                if (sh->f[i].channel == ch)
+                    k[tr.count++] = (struct servo_knot){
+                        .t_ms = sh->f[i].t_ms, .angle_mdeg = sh->f[i].angle_mdeg,
+                    };
+                i++;
+            }
+            if (!tr.count) {
+                cur[ch] = i;    /* channel finished */
+                continue;
+            }
+            done = 0;
+
+            tr.flags = loaded[ch] ? SERVO_TRAJ_APPEND : 0;
+            if (ioctl(fds[ch], SERVO_IOCTL_TRAJ_LOAD, &tr) < 0) {
+                if (errno == ENOSPC)
+                    continue;   /* ring full, retry once it drained */
+                if (errno == EINVAL && loaded[ch]) {
+                    /* trajectory ran dry before we appended: restart it */
+                    fprintf(stderr, "channel %d: trajectory underrun\n", ch);
+                    loaded[ch] = 0;
+                    continue;
+                }
+                return -1;
+            }
+            loaded[ch] = 1;
+            cur[ch] = i;
+            progress = 1;
+        }
+        if (!done && !progress)
+            sleep_ms(100);
+    } while (!done);
+
+    /* until the last knot has been played */
+    sleep_until(start + (uint64_t)sh->f[sh->count - 1].t_ms * 1000000ULL);
+    return 0;
+}
+
+static int mdeg_to_deg(int mdeg) {
+    return (mdeg + (mdeg < 0 ? -500 : 500)) / 1000;
+}
+
+/*
+ * Per frame group: SET_ANGLE_AT ahead of time, or sleep and SET_ANGLE;
+ * one ioctl per frame either way.
+ */
+static int play_timed(const struct show *sh, const int *fds, uint64_t start,
+                      enum play_mode mode) {
+    for (size_t i = 0; i < sh->count; ) {
+        uint64_t t = start + (uint64_t)sh->f[i].t_ms * 1000000ULL;
+        size_t j;
+
+        sleep_until(mode == PLAY_AT ? t - PLAY_AHEAD_MS * 1000000ULL : t);
+
+        /* all frames of this timestamp back to back */
+        for (j = i; j < sh->count && sh->f[j].t_ms == sh->f[i].t_ms; j++) {
+            int fd = fds[sh->f[j].channel];
+            int deg = mdeg_to_deg(sh->f[j].angle_mdeg);
+            int ret;
+
+            if (mode == PLAY_AT) {
+                struct servo_timed tc = { .deadline_ns = (int64_t)t, .value = deg };
+                while ((ret = ioctl(fd, SERVO_IOCTL_SET_ANGLE_AT, &tc)) < 0 && errno == ENOSPC)
+                    sleep_ms(1);
+            } else {
+                ret = ioctl(fd, SERVO_IOCTL_SET_ANGLE, &deg);
+            }
+            if (ret < 0)
+                return -1;
+        }
+        i = j;
+    }
+    return 0;
+}
+
+/*
+ * Sleep, then the whole frame group as one STAGE_BATCH + COMMIT on
+ * /dev/servo-ctl, so its channels move on the same tick. Returns 1
+ * without having moved anything if the driver has no batched interface.
+ */
+static int play_batch(const struct show *sh, const int *fds, uint64_t start) {
+    static struct servo_stage sg[PLAY_MAX_CH];
+    struct servo_stage_batch b = { .stages = (uintptr_t)sg, .flags = SERVO_BATCH_COMMIT };
+    struct servo_state st;
+    uint32_t index[PLAY_MAX_CH];
+    int sent = 0, fd = open("/dev/" SERVO_CTL_NAME, O_RDWR);
+
+    if (fd < 0)
+        return 1;
+    /* N of /dev/servoN, whatever the node is called */
+    for (int ch = 0; ch < PLAY_MAX_CH; ch++) {
+        if (fds[ch] < 0)
+            continue;
+        if (ioctl(fds[ch], SERVO_IOCTL_GET_STATE, &st) < 0) {
+            close(fd);
+            return 1;
+        }
+        index[ch] = st.index;
+    }
+
+    for (size_t i = 0; i < sh->count; ) {
+        uint32_t t_ms = sh->f[i].t_ms;
+
+        sleep_until(start + (uint64_t)t_ms * 1000000ULL);
+        /* a channel appears once per timestamp: at most PLAY_MAX_CH stages */
+        for (b.count = 0; i < sh->count && sh->f[i].t_ms == t_ms; i++)
+            sg[b.count++] = (struct servo_stage){
+                .mask = SERVO_STAGE_ANGLE, .index = index[sh->f[i].channel],
+                .angle = mdeg_to_deg(sh->f[i].angle_mdeg),
+            };
+        if (ioctl(fd, SERVO_IOCTL_STAGE_BATCH, &b) < 0) {
+            close(fd);
+            return errno == ENOTTY && !sent ? 1 : -1;
+        }
+        sent = 1;
+    }
+    close(fd);
+    return 0;
+}
+
+static int cmd_play(int argc, char **argv) {
+    const char *pattern = "/dev/servo%u", *path = NULL;
+    enum play_mode mode = PLAY_TRAJ;
+    int fds[PLAY_MAX_CH], en = 1, zero = 0, ret = 1;
+    struct show sh = { 0 };
+    uint64_t start;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            pattern = argv[++i];
+        } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "traj"))       mode = PLAY_TRAJ;
+            else if (!strcmp(argv[i], "at"))    mode = PLAY_AT;
+            else if (!strcmp(argv[i], "sleep")) mode = PLAY_SLEEP;
+            else {
+                fprintf(stderr, "play: unknown mode '%s' (traj, at, sleep)\n", argv[i]);
+                return 2;
+            }
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "play requires FILE\n");
+        return 2;
+    }
+
+    for (int ch = 0; ch < PLAY_MAX_CH; ch++)
+        fds[ch] = -1;
+    if (show_load(&sh, path) < 0)
+        goto out;
+    if (!sh.count) {
+        fprintf(stderr, "%s: no keyframes\n", path);
+        goto out;
+    }
+    for (size_t i = 0; i < sh.count; i++) {
+        unsigned int ch = sh.f[i].channel;
+        char dev[64];
+
+        if (fds[ch] >= 0)
+            continue;
+        snprintf(dev, sizeof(dev), pattern, ch);
+        if ((fds[ch] = open_dev(dev)) < 0)
+            goto out;
+        if (ioctl(fds[ch], SERVO_IOCTL_ENABLE, &en) < 0) {
+            perror(dev);
+            goto out;
+        }
+        /* keyframes are positions, not targets for the speed limiter */
+        ioctl(fds[ch], SERVO_IOCTL_SET_SPEED, &zero);
+    }
+
+    printf("play: %zu keyframes, %.1f s\n", sh.count, sh.f[sh.count - 1].t_ms / 1000.0);
+    start = mono_ns() + PLAY_LEAD_MS * 1000000ULL;
+
+    if (mode == PLAY_TRAJ) {
+        if (play_traj(&sh, fds, start) == 0)
+            ret = 0;
+        else if (errno == ENOTTY)
+            mode = PLAY_AT;     /* driver without trajectories */
+        else
+            perror("TRAJ_LOAD");
+    }
+    if (mode == PLAY_AT) {
+        if (play_timed(&sh, fds, start, PLAY_AT) == 0)
+            ret = 0;
+        else if (errno == ENOTTY)
+            mode = PLAY_SLEEP;  /* nor timed commands */
+        else
+            perror("SET_ANGLE_AT");
+    }
+    if (mode == PLAY_SLEEP) {
+        /* one commit per frame group, else one SET_ANGLE per frame */
+        int r = play_batch(&sh, fds, start);
+
+        if (r < 0)
+            perror("STAGE_BATCH");
+        else if (r == 0 || play_timed(&sh, fds, start, PLAY_SLEEP) == 0)
+            ret = 0;
+        else
+            perror("SET_ANGLE");
+    }
+
+out:
+    for (int ch = 0; ch < PLAY_MAX_CH; ch++)
+        if (fds[ch] >= 0)
+            close(fds[ch]);
+    show_free(&sh);
+    return ret;
+}
+
+/* ---------- one-shot commands, fanned out over devices ---------- */
+
+#define FAN_MAX_DEVS  256
+
+struct fan_job {
+    pthread_t     tid;
+    const char   *dev;
+    int           fd;
+    const char   *cmd;
+    int           argc;      /* cmd and its parameters */
+    char        **argv;
+    int           speed;
+    int           step;
+    int           ret;       /* exit code */
+    char          msg[256];
+    uint64_t      ns;
+};
+
+static void state_str(char *buf, size_t len, const struct servo_state *st) {
+    if (st->flags & SERVO_STATE_VELOCITY) {
+        snprintf(buf, len,
+                 "servo%u: %s%s%s velocity %d -> %d permille, pulse %u ns",
+                 st->index, (st->flags & SERVO_STATE_ENABLED) ? "enabled" : "disabled",
+                 (st->flags & SERVO_STATE_ESTOP) ? " E-STOP" : "",
+                 (st->flags & SERVO_STATE_MOVING) ? " moving" : "",
+                 st->velocity, st->target_velocity, st->pulse_ns);
+        return;
+    }
+    snprintf(buf, len,
+             "servo%u: %s%s%s angle %d.%03d° -> %d°, speed %d°/s, pulse %u ns, "
+             "queued %u timed / %u knots / %u ring",
+             st->index, (st->flags & SERVO_STATE_ENABLED) ? "enabled" : "disabled",
+             (st->flags & SERVO_STATE_ESTOP) ? " E-STOP" : "",
+             (st->flags & SERVO_STATE_MOVING) ? " moving" : "",
+             st->cur_mdeg / 1000, abs(st->cur_mdeg % 1000), st->target_angle,
+             st->speed_dps, st->pulse_ns, st->timed_depth, st->traj_depth, st->ring_depth);
+}
+
+/* All servos of the controller in one GET_STATES on /dev/servo-ctl */
+static int cmd_states(void) {
+    struct servo_state st[SERVO_MAX_STATES];
+    struct servo_states req = { .states = (uintptr_t)st, .count = SERVO_MAX_STATES };
+    char line[256];
+    int fd = open_dev("/dev/" SERVO_CTL_NAME);
+
+    if (fd < 0)
+        return 1;
+    uint64_t t0 = mono_ns();
+    if (ioctl(fd, SERVO_IOCTL_GET_STATES, &req) < 0) {
+        perror("GET_STATES");
+        close(fd);
+        return 1;
+    }
+    uint64_t ns = mono_ns() - t0;
+    close(fd);
+
+    for (unsigned int i = 0; i < req.count; i++) {
+        state_str(line, sizeof(line), &st[i]);
+        printf("%s\n", line);
+    }
+    if (req.total > req.count)
+        printf("(%u more not shown)\n", req.total - req.count);
+    printf("%u servos in %.1f us\n", req.total, ns / 1e3);
+    return 0;
+}
+
+#define JOB_FAIL(j, what, code) do {                                        \
+        snprintf((j)->msg, sizeof((j)->msg), "%s: %s", what, strerror(errno)); \
+        return (code);                                                      \
+    } while (0)
+
+/* Run the command on j->fd; result text in j->msg, returns the exit code */
+static int job_run(struct fan_job *j) {
+    const char *cmd = j->cmd;
+    int fd = j->fd;
+
+    /* E-STOP must not enable the output first */
+    if (!strcmp(cmd, "estop") || !strcmp(cmd, "estop-all")) {
+        unsigned long req = !strcmp(cmd, "estop") ? SERVO_IOCTL_ESTOP
+                                                  : SERVO_IOCTL_ESTOP_ALL;
+        if (ioctl(fd, req, 0) < 0)
+            JOB_FAIL(j, "ESTOP", 1);
+        snprintf(j->msg, sizeof(j->msg), "E-STOP issued");
+        return 0;
+    }
+
+    /* read-only, leaves the output as it is */
+    if (!strcmp(cmd, "state")) {
+        struct servo_state st;
+        if (ioctl(fd, SERVO_IOCTL_GET_STATE, &st) < 0)
+            JOB_FAIL(j, "GET_STATE", 1);
+        state_str(j->msg, sizeof(j->msg), &st);
+        return 0;
+    }
+
+    /* enable device */
+    int en = 1;
+    if (ioctl(fd, SERVO_IOCTL_ENABLE, &en) < 0)
+        JOB_FAIL(j, "ENABLE", 1);
+
+    /* optional speed, not fatal */
+    ioctl(fd, SERVO_IOCTL_SET_SPEED, &j->speed);
+
+    /* handle set-limits / get-limits first */
+    if (!strcmp(cmd, "get-limits")) {
+        struct servo_limits L;
+        if (ioctl(fd, SERVO_IOCTL_GET_LIMITS, &L) < 0)
+            JOB_FAIL(j, "GET_LIMITS", 1);
+        limits_str(j->msg, sizeof(j->msg), &L);
+        return 0;
+    }
+
+    if (!strcmp(cmd, "set-limits")) {
+        long min_us = strtol(j->argv[1], NULL, 10);
+        long max_us = strtol(j->argv[2], NULL, 10);
+
+        struct servo_limits L = {
+            .min_angle = 0,
+            .max_angle = 180,
+            .min_pulse_ns = (unsigned int)(min_us * 1000UL),
+            .max_pulse_ns = (unsigned int)(max_us * 1000UL),
+        };
+
+        if (ioctl(fd, SERVO_IOCTL_SET_LIMITS, &L) < 0)
+            JOB_FAIL(j, "SET_LIMITS", 1);
+        strcpy(j->msg, "SET_LIMITS ok: ");
+        limits_str(j->msg + strlen(j->msg), sizeof(j->msg) - strlen(j->msg), &L);
+        return 0;
+    }
+
+    if (!strcmp(cmd, "rotation")) {
+        struct servo_rotation r = {
+            .mode = !strcmp(j->argv[1], "velocity") ? SERVO_MODE_VELOCITY : SERVO_MODE_POSITION,
+        };
+        if (j->argc > 2) r.neutral_ns = (__u32)strtoul(j->argv[2], NULL, 10);
+        if (j->argc > 3) r.deadband_ns = (__u32)strtoul(j->argv[3], NULL, 10);
+        if (j->argc > 4) r.ramp_pmps = (__u32)strtoul(j->argv[4], NULL, 10);
+        if (ioctl(fd, SERVO_IOCTL_SET_ROTATION, &r) < 0)
+            JOB_FAIL(j, "SET_ROTATION", 1);
+        snprintf(j->msg, sizeof(j->msg), "%s mode", j->argv[1]);
+        return 0;
+    }
+
+    if (!strcmp(cmd, "protocol")) {
+        struct servo_protocol p = { .protocol = (__u32)proto_parse(j->argv[1]) };
+        if (j->argc > 2)
+            p.period_ns = (__u32)strtoul(j->argv[2], NULL, 10);
+        if (ioctl(fd, SERVO_IOCTL_SET_PROTOCOL, &p) < 0)
+            JOB_FAIL(j, "SET_PROTOCOL", 1);
+        if (ioctl(fd, SERVO_IOCTL_GET_PROTOCOL, &p) < 0)
+            JOB_FAIL(j, "GET_PROTOCOL", 1);
+        snprintf(j->msg, sizeof(j->msg), "Protocol %s, period %u ns (%.1f Hz)",
+                 proto_names[p.protocol], p.period_ns, 1e9 / p.period_ns);
+        return 0;
+    }
+
+    if (!strcmp(cmd, "timing")) {
+        struct servo_timing t = {};
+        if (j->argc > 1) t.period_ns = (__u32)strtoul(j->argv[1], NULL, 10);
+        if (j->argc > 2) t.tick_us = (__u32)strtoul(j->argv[2], NULL, 10);
+        if ((t.period_ns || t.tick_us) && ioctl(fd, SERVO_IOCTL_SET_TIMING, &t) < 0)
+            JOB_FAIL(j, "SET_TIMING", 1);
+        if (ioctl(fd, SERVO_IOCTL_GET_TIMING, &t) < 0)
+            JOB_FAIL(j, "GET_TIMING", 1);
+        snprintf(j->msg, sizeof(j->msg), "Period %u ns (%.1f Hz), tick %u us, effective %u ns",
+                 t.period_ns, 1e9 / t.period_ns, t.tick_us, t.tick_ns);
+        return 0;
+    }
+
+    if (!strcmp(cmd, "velocity")) {
+        int v = atoi(j->argv[1]);
+        if (ioctl(fd, SERVO_IOCTL_SET_VELOCITY, &v) < 0)
+            JOB_FAIL(j, "SET_VELOCITY (velocity mode?)", 1);
+        snprintf(j->msg, sizeof(j->msg), "Velocity set to: %d permille", v);
+        return 0;
+    }
+
+    if (!strcmp(cmd, "pulse")) {
+        __u32 ns = (__u32)strtoul(j->argv[1], NULL, 10);
+        if (ioctl(fd, SERVO_IOCTL_SET_PULSE_NS, &ns) < 0)
+            JOB_FAIL(j, "SET_PULSE_NS", 1);
+        if (ioctl(fd, SERVO_IOCTL_GET_PULSE_NS, &ns) < 0)
+            JOB_FAIL(j, "GET_PULSE_NS", 1);
+        snprintf(j->msg, sizeof(j->msg), "Pulse set to: %u ns", ns);
+        return 0;
+    }
+
+    /* read current angle (for step operations) */
+    int angle = 0;
+    if (ioctl(fd, SERVO_IOCTL_GET_ANGLE, &angle) < 0) {
+        /* if driver doesn't return a valid angle, assume 0 */
+        angle = 0;
+    }
+
+    int target = parse_target(cmd, angle, j->step);
+    if (ioctl(fd, SERVO_IOCTL_SET_ANGLE, &target) < 0)
+        JOB_FAIL(j, "SET_ANGLE", 1);
+
+    /* status */
+    int cur = target;
+    if (ioctl(fd, SERVO_IOCTL_GET_ANGLE, &cur) == 0)
+        snprintf(j->msg, sizeof(j->msg), "Angle set to: %d°", cur);
+    else
+        snprintf(j->msg, sizeof(j->msg), "Angle set to: %d° (GET_ANGLE not available)", target);
+
+    /* keep enabled; if you want to disable at end:
+       en = 0; ioctl(fd, SERVO_IOCTL_ENABLE, &en); */
+    return 0;
+}
+
+static void *job_thread(void *arg) {
+    struct fan_job *j = arg;
+    uint64_t t0 = mono_ns();
+
+    j->ret = job_run(j);
+    j->ns = mono_ns() - t0;
+    return NULL;
+}
+
+/*
+ * Absolute move on several devices as one STAGE_BATCH + COMMIT on
+ * /dev/servo-ctl, so all of them start on the same commit. Returns -1
+ * without having moved anything if the driver has no batched interface.
+ */
+static int fan_batch(struct fan_job *jobs, int n, int target, uint64_t *ns) {
+    struct servo_stage sg[FAN_MAX_DEVS];
+    struct servo_stage_batch b = { .stages = (uintptr_t)sg, .flags = SERVO_BATCH_COMMIT };
+    struct servo_state st[FAN_MAX_DEVS];
+    int en = 1, ret = 0, fd = open("/dev/" SERVO_CTL_NAME, O_RDWR);
+
+    if (fd < 0)
+        return -1;
+    /* N of /dev/servoN, whatever the node is called */
+    for (int i = 0; i < n; i++) {
+        if (ioctl(jobs[i].fd, SERVO_IOCTL_GET_STATE, &st[i]) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    uint64_t t0 = mono_ns();
+    for (int i = 0; i < n; i++) {
+        if (ioctl(jobs[i].fd, SERVO_IOCTL_ENABLE, &en) < 0) {
+            jobs[i].ret = 1;
+            snprintf(jobs[i].msg, sizeof(jobs[i].msg), "ENABLE: %s", strerror(errno));
+            continue;
+        }
+        sg[b.count++] = (struct servo_stage){
+            .mask = SERVO_STAGE_ANGLE | SERVO_STAGE_SPEED, .index = st[i].index,
+            .angle = target, .speed_dps = jobs[i].speed,
+        };
+    }
+    if (b.count && ioctl(fd, SERVO_IOCTL_STAGE_BATCH, &b) < 0) {
+        if (errno == ENOTTY) {
+            close(fd);
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            if (jobs[i].ret)
+                continue;
+            jobs[i].ret = 1;
+            snprintf(jobs[i].msg, sizeof(jobs[i].msg), "STAGE_BATCH: %s", strerror(errno));
+        }
+    }
+    *ns = mono_ns() - t0;
+    close(fd);
+
+    for (int i = 0; i < n; i++) {
+        if (!jobs[i].ret)
+            snprintf(jobs[i].msg, sizeof(jobs[i].msg), "Angle committed: %d°", target);
+        if (jobs[i].ret > ret)
+            ret = jobs[i].ret;
+    }
+    return ret;
+}
+
+/* A glob match only counts as /dev/servoN: not /dev/servo-ctl or other nodes */
+static int is_servo_node(const char *path) {
+    const char *base = strrchr(path, '/');
+
+    base = base ? base + 1 : path;
+    if (!strcmp(base, SERVO_CTL_NAME) || strncmp(base, "servo", 5) || !base[5])
+        return 0;
+    return strspn(base + 5, "0123456789") == strlen(base + 5);
+}
+
+/* Add a device, a comma list or a quoted glob ("/dev/servo*") */
+static int add_devices(const char **devs, int *n, char *spec) {
+    char *save, *tok;
+
+    for (tok = strtok_r(spec, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (strpbrk(tok, "*?[")) {
+            glob_t g;
+            int before = *n;
+
+            if (glob(tok, 0, NULL, &g)) {
+                fprintf(stderr, "no device matches %s\n", tok);
+                return -1;
+            }
+            /* kept until exit */
+            for (size_t i = 0; i < g.gl_pathc && *n < FAN_MAX_DEVS; i++)
+                if (is_servo_node(g.gl_pathv[i]))
+                    devs[(*n)++] = g.gl_pathv[i];
+            if (*n == before) {
+                fprintf(stderr, "no servo device matches %s\n", tok);
+                return -1;
+            }
+        } else if (*n < FAN_MAX_DEVS) {
+            devs[(*n)++] = tok;
+        }
+    }
+    return 0;
 }
 
 int main(int argc, char **argv)
 {
-    const char *dev = "/dev/servo0";
+    static const char *devs[FAN_MAX_DEVS];
+    static struct fan_job jobs[FAN_MAX_DEVS];
+    int ndevs = 0;
     int speed = 90;            /* deg/s; 0 = immediate */
     int step = 10;             /* step size in degrees */
     const char *cmd = NULL;
+    const char *prog = argv[0];
 
     /* parse options */
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--device") && i + 1 < argc) {
-            dev = argv[++i];
+            if (add_devices(devs, &ndevs, argv[++i]) < 0)
+                return 1;
         } else if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
             speed = atoi(argv[++i]);
             if (speed < 0) speed = 0;
@@ -72,7 +1205,7 @@ int main(int argc, char **argv)
             step = atoi(argv[++i]);
             if (step < 1) step = 1;
         } else if (argv[i][0] == '-' && strcmp(argv[i], "-") != 0) {
-            usage(argv[0]);
+            usage(prog);
             return 2;
         } else {
             cmd = argv[i];
@@ -81,120 +1214,129 @@ int main(int argc, char **argv)
             break;
         }
     }
+    if (!ndevs)
+        devs[ndevs++] = "/dev/servo0";
 
     if (!cmd) {
-        usage(argv[0]);
+        usage(prog);
         return 2;
     }
 
-    int fd = open_dev(dev);
-    if (fd < 0) return 1;
-
-    /* enable device */
-    int en = 1;
-    if (ioctl(fd, SERVO_IOCTL_ENABLE, &en) < 0) {
-        perror("ENABLE");
-        close(fd);
-        return 1;
-    }
+    /* bench and play open their own devices */
+    if (!strcmp(cmd, "bench"))
+        return cmd_bench(devs[0], speed, argc, argv);
+    if (!strcmp(cmd, "play"))
+        return cmd_play(argc, argv);
+    if (!strcmp(cmd, "states"))
+        return cmd_states();
 
-    /* optional speed */
-    if (ioctl(fd, SERVO_IOCTL_SET_SPEED, &speed) < 0) {
-        perror("SET_SPEED");
-        /* not fatal */
-    }
-
-    /* handle set-limits / get-limits first */
-    if (!strcmp(cmd, "get-limits")) {
-        struct servo_limits L;
-        if (ioctl(fd, SERVO_IOCTL_GET_LIMITS, &L) < 0) {
-            perror("GET_LIMITS");
-            close(fd);
-            return 1;
-        }
-        print_limits(&L);
-        close(fd);
-        return 0;
+    /* shell decides itself which ioctls are needed */
+    if (!strcmp(cmd, "shell")) {
+        int fd = open_dev(devs[0]);
+        if (fd < 0) return 1;
+        return cmd_shell(fd, speed, step);
     }
 
+    /* validate before touching any device */
     if (!strcmp(cmd, "set-limits")) {
         if (argc < 3) {
             fprintf(stderr, "set-limits requires <min_us> <max_us>\n");
-            usage(argv[0]);
-            close(fd);
+            usage(prog);
             return 2;
         }
         long min_us = strtol(argv[1], NULL, 10);
         long max_us = strtol(argv[2], NULL, 10);
         if (min_us <= 0 || max_us <= 0 || min_us >= max_us) {
             fprintf(stderr, "invalid limits: %ld..%ld us\n", min_us, max_us);
-            close(fd);
             return 2;
         }
+    } else if (!strcmp(cmd, "rotation")) {
+        if (argc < 2 || (strcmp(argv[1], "position") && strcmp(argv[1], "velocity"))) {
+            fprintf(stderr, "rotation requires position|velocity\n");
+            usage(prog);
+            return 2;
+        }
+    } else if (!strcmp(cmd, "protocol")) {
+        if (argc < 2 || proto_parse(argv[1]) < 0) {
+            fprintf(stderr, "protocol requires standard|oneshot125|oneshot42|multishot\n");
+            usage(prog);
+            return 2;
+        }
+    } else if (!strcmp(cmd, "timing")) {
+        if ((argc > 1 && strtol(argv[1], NULL, 10) < 0) ||
+            (argc > 2 && strtol(argv[2], NULL, 10) < 0)) {
+            fprintf(stderr, "timing requires PERIOD_NS and TICK_US >= 0\n");
+            usage(prog);
+            return 2;
+        }
+    } else if (!strcmp(cmd, "velocity")) {
+        if (argc < 2) {
+            fprintf(stderr, "velocity requires <v>\n");
+            usage(prog);
+            return 2;
+        }
+    } else if (!strcmp(cmd, "pulse")) {
+        if (argc < 2 || strtol(argv[1], NULL, 10) <= 0) {
+            fprintf(stderr, "pulse requires <ns> > 0\n");
+            usage(prog);
+            return 2;
+        }
+    } else if (strcmp(cmd, "estop") && strcmp(cmd, "estop-all") &&
+               strcmp(cmd, "get-limits") && strcmp(cmd, "state") &&
+               parse_target(cmd, 0, step) < 0) {
+        fprintf(stderr, "Unknown command: %s\n\n", cmd);
+        usage(prog);
+        return 2;
+    }
 
-        struct servo_limits L = {
-            .min_angle = 0,
-            .max_angle = 180,
-            .min_pulse_ns = (unsigned int)(min_us * 1000UL),
-            .max_pulse_ns = (unsigned int)(max_us * 1000UL),
+    /* open all first, so the commands go out back to back */
+    for (int i = 0; i < ndevs; i++) {
+        jobs[i] = (struct fan_job){
+            .dev = devs[i], .cmd = cmd, .argc = argc, .argv = argv,
+            .speed = speed, .step = step,
         };
-
-        if (ioctl(fd, SERVO_IOCTL_SET_LIMITS, &L) < 0) {
-            perror("SET_LIMITS");
-            close(fd);
+        jobs[i].fd = open_dev(devs[i]);
+        if (jobs[i].fd < 0)
             return 1;
-        }
-        printf("SET_LIMITS ok: ");
-        print_limits(&L);
-        close(fd);
-        return 0;
     }
 
-    /* read current angle (for step operations) */
-    int angle = 0;
-    if (ioctl(fd, SERVO_IOCTL_GET_ANGLE, &angle) < 0) {
-        /* if driver doesn't return a valid angle, assume 0 */
-        angle = 0;
+    if (ndevs == 1) {
+        int ret = job_run(&jobs[0]);
+        fprintf(ret ? stderr : stdout, "%s\n", jobs[0].msg);
+        close(jobs[0].fd);
+        return ret;
     }
 
-    int target = -1;
-    if (!strcmp(cmd, "to45"))       target = 45;
-    else if (!strcmp(cmd, "to90"))  target = 90;
-    else if (!strcmp(cmd, "to135")) target = 135;
-    else if (!strcmp(cmd, "to180")) target = 180;
-    else if (!strcmp(cmd, "step+")) target = clamp(angle + step, 0, 180);
-    else if (!strcmp(cmd, "step-")) target = clamp(angle - step, 0, 180);
-    else {
-        /* numeric angle */
-        char *endp = NULL;
-        long v = strtol(cmd, &endp, 10);
-        if (endp && *endp == '\0') {
-            target = clamp((int)v, 0, 180);
-        } else {
-            fprintf(stderr, "Unknown command: %s\n\n", cmd);
-            usage(argv[0]);
-            close(fd);
-            return 2;
+    /* absolute moves go out as one commit when the driver supports it */
+    int ret = strncmp(cmd, "step", 4) ? parse_target(cmd, 0, step) : -1;
+    uint64_t total;
+    if (ret >= 0 && (ret = fan_batch(jobs, ndevs, ret, &total)) >= 0) {
+        for (int i = 0; i < ndevs; i++) {
+            printf("%-16s %s\n", jobs[i].dev, jobs[i].msg);
+            close(jobs[i].fd);
         }
+        printf("%d devices in one commit, %.1f us\n", ndevs, total / 1e3);
+        return ret;
     }
 
-    if (ioctl(fd, SERVO_IOCTL_SET_ANGLE, &target) < 0) {
-        perror("SET_ANGLE");
-        close(fd);
-        return 1;
+    ret = 0;
+    uint64_t t0 = mono_ns();
+    for (int i = 0; i < ndevs; i++) {
+        if (pthread_create(&jobs[i].tid, NULL, job_thread, &jobs[i])) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
     }
+    for (int i = 0; i < ndevs; i++)
+        pthread_join(jobs[i].tid, NULL);
+    total = mono_ns() - t0;
 
-    /* status */
-    int cur = target;
-    if (ioctl(fd, SERVO_IOCTL_GET_ANGLE, &cur) == 0) {
-        printf("Angle set to: %d°\n", cur);
-    } else {
-        printf("Angle set to: %d° (GET_ANGLE not available)\n", target);
+    for (int i = 0; i < ndevs; i++) {
+        printf("%-16s %8.1f us  %s\n", jobs[i].dev, jobs[i].ns / 1e3, jobs[i].msg);
+        if (jobs[i].ret > ret)
+            ret = jobs[i].ret;
+        close(jobs[i].fd);
     }
-
-    /* keep enabled; if you want to disable at end:
-       en = 0; ioctl(fd, SERVO_IOCTL_ENABLE, &en); */
-
-    close(fd);
-    return 0;
+    printf("%d devices in %.1f us\n", ndevs, total / 1e3);
+    return ret;
 }
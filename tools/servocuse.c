@@ -0,0 +1,1197 @@
+/*
+ * servocuse: userspace emulation of a servo device through CUSE.
+ *
+ * Creates /dev/NAME (default servo0) and implements the servo_uapi.h ioctl
+ * set on top of the shared motion core (servo_motion.h), with a tick
+ * thread in place of the motion work and a simulated PWM output. servoctl
+ * and applications run against it unchanged, without the kernel module or
+ * hardware; only access to /dev/cuse is needed.
+ *
+ *   servocuse [-n NAME] [-t TICK_MS] [-c] [-v] [-f] [-d]
+ *
+ * -c also creates /dev/servo-ctl (GET_STATES, STAGE_BATCH, the controller
+ * eventfd) for this one servo, so only one instance can have it. -v prints
+ * every simulated PWM apply in the servo_mock_pwm log format ("seq ts_ns
+ * channel enabled duty_ns period_ns"), -f stays in the foreground, -d adds
+ * FUSE debugging.
+ *
+ * Missing under CUSE:
+ *   - mmap of the setpoint ring: CUSE has no mmap, so it fails with
+ *     ENODEV. RING_KICK succeeds without effect and ring_depth stays 0.
+ *   - 32-bit callers on a 64-bit host: every ioctl fails with ENOSYS.
+ * SET_EVENTFD copies the caller's eventfd with pidfd_getfd(), which needs
+ * ptrace access to the caller (same user; with Yama, ptrace_scope 0) and
+ * fails with EPERM without it.
+ *
+ * Differences from servo.c: SET_ANGLE_AT/ENABLE_AT run on the first tick
+ * at or after the deadline (no hrtimer pull-in), ESTOP_ALL and COMMIT only
+ * act on this device, SET_PULSE_NS applies directly also when streaming,
+ * PWM_FAULT only comes from a stage dropped after a period change,
+ * SET_PROTOCOL only takes the standard protocol (any period), and the
+ * tick runs on its own clock, not phase-locked to a PWM frame.
+ */
+#define FUSE_USE_VERSION 35
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <cuse_lowlevel.h>
+#include <fuse_opt.h>
+
+#include "servo_motion.h"
+
+#define EMU_PERIOD_NS       20000000U   /* 20 ms -> 50 Hz */
+#define EMU_MAX_PERIOD_NS   100000000U
+#define EMU_MIN_TICK_US     500U
+#define EMU_MAX_TICK_US     1000000U
+#define EMU_TIMED_DEPTH     16
+#define EMU_TRAJ_MAX_KNOTS  1024
+#define EMU_TRAJ_MAX_VEL    100000000
+#define EMU_STREAM_MAX_NS   1000000000LL
+#define EMU_VEL_MAX_RAMP    1000000
+#define EMU_MAX_BATCH       256
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open      434
+#endif
+#ifndef SYS_pidfd_getfd
+#define SYS_pidfd_getfd     438
+#endif
+
+struct emu_timed {
+    int64_t  deadline_ns;
+    int      enable;        /* ENABLE_AT, else SET_ANGLE_AT */
+    int      value;
+};
+
+/* Mirrors struct servo_dev; everything under lock */
+struct emu {
+    pthread_mutex_t      lock;
+    unsigned int         index;         /* N of the device name servoN */
+    unsigned int         tick_us;       /* as set, see emu_tick_ns() */
+    unsigned int         period_ns;
+    int                  verbose;
+
+    int                  enabled;
+    int                  estop;
+    int                  cur_angle;
+    int                  cur_mdeg;
+    int                  target_angle;
+    int                  speed_dps;
+    unsigned int         raw_pulse_ns;  /* 0 = angle mode */
+    struct servo_limits  limits;
+
+    struct emu_timed     timed[EMU_TIMED_DEPTH];
+    unsigned int         timed_count;
+
+    struct servo_knot    traj[EMU_TRAJ_MAX_KNOTS];
+    unsigned int         traj_head;
+    unsigned int         traj_count;
+    int64_t              traj_start;
+    int                  traj_active;
+
+    int                  stream_on;
+    int                  stream_moving;
+    int64_t              stream_horizon_ns;
+    int64_t              stream_dur_ns;
+    int64_t              stream_t0;
+    int                  stream_from;
+    int                  stream_to;
+
+    struct servo_stage   stage;         /* mask 0: nothing staged */
+    int                  committed;     /* stage due on the next tick */
+
+    int                  vel_mode;
+    int                  vel_target;
+    int                  vel_cur;
+    unsigned int         vel_neutral_ns; /* 0: middle of the pulse limits */
+    unsigned int         vel_deadband_ns;
+    unsigned int         vel_ramp;      /* permille per second; 0 = jump */
+
+    /* eventfds are our copies of the callers', -1 = none */
+    uint32_t             ev_pending;    /* SERVO_EV_*, until GET_EVENTS */
+    int                  evfd;
+    uint32_t             ev_mask;
+    int                  ctl_evfd;      /* set on /dev/servo-ctl */
+    uint32_t             ctl_ev_mask;
+    int                  ctl_pending;   /* until GET_PENDING */
+
+    /* simulated PWM */
+    unsigned int         duty_ns;
+    uint64_t             applies;
+};
+
+static struct emu emu = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .tick_us = 20000,
+    .period_ns = EMU_PERIOD_NS,
+    .cur_angle = 90,
+    .cur_mdeg = 90000,
+    .target_angle = 90,
+    .limits = { 0, 180, 1000000, 2000000 },
+    .evfd = -1,
+    .ctl_evfd = -1,
+};
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ---------- PWM / motion, called with emu.lock held ---------- */
+
+static void emu_pwm(struct emu *e, int enabled, unsigned int duty_ns) {
+    e->duty_ns = duty_ns;
+    if (e->verbose)
+        printf("%llu %lld 0 %d %u %u\n", (unsigned long long)e->applies,
+               (long long)now_ns(), enabled, duty_ns, e->period_ns);
+    e->applies++;
+}
+
+static void emu_signal(int fd) {
+    uint64_t one = 1;
+
+    /* EAGAIN only at the counter's limit: still signalled */
+    if (write(fd, &one, sizeof(one)) < 0)
+        return;
+}
+
+/* As servo_event(): record ev and signal the eventfds that asked for it */
+static void emu_event(struct emu *e, uint32_t ev) {
+    e->ev_pending |= ev;
+    if (e->evfd >= 0 && (ev & e->ev_mask))
+        emu_signal(e->evfd);
+    if (ev & e->ctl_ev_mask) {
+        e->ctl_pending = 1;
+        emu_signal(e->ctl_evfd);
+    }
+}
+
+static void emu_apply_mdeg(struct emu *e, int mdeg) {
+    if (!e->enabled || e->estop)
+        return;
+    emu_pwm(e, 1, servo_core_pulse_ns(&e->limits, mdeg));
+    e->cur_mdeg = mdeg;
+    e->cur_angle = mdeg >= 0 ? (mdeg + 500) / 1000 : (mdeg - 500) / 1000;
+}
+
+static void emu_set_target(struct emu *e, int angle) {
+    if (angle < e->limits.min_angle) angle = e->limits.min_angle;
+    if (angle > e->limits.max_angle) angle = e->limits.max_angle;
+    e->target_angle = angle;
+    e->raw_pulse_ns = 0;
+    e->traj_active = 0;
+    e->traj_count = 0;
+}
+
+static void emu_apply_raw(struct emu *e, unsigned int ns) {
+    if (!e->enabled || e->estop)
+        return;
+    emu_pwm(e, 1, ns);
+    e->cur_mdeg = servo_core_pulse_mdeg(&e->limits, ns);
+    e->cur_angle = e->cur_mdeg >= 0 ? (e->cur_mdeg + 500) / 1000 : (e->cur_mdeg - 500) / 1000;
+    e->target_angle = e->cur_angle;
+}
+
+static void emu_set_pulse(struct emu *e, unsigned int ns) {
+    if (ns < e->limits.min_pulse_ns) ns = e->limits.min_pulse_ns;
+    if (ns > e->limits.max_pulse_ns) ns = e->limits.max_pulse_ns;
+    e->raw_pulse_ns = ns;
+    e->traj_active = 0;
+    e->traj_count = 0;
+    e->stream_moving = 0;
+    emu_apply_raw(e, ns);
+}
+
+/* Continuous rotation: output for velocity vel (permille) */
+static void emu_apply_velocity(struct emu *e, int vel) {
+    if (!e->enabled || e->estop)
+        return;
+    emu_pwm(e, 1, servo_core_vel_pulse_ns(&e->limits, e->vel_neutral_ns,
+                                          e->vel_deadband_ns, vel));
+    e->vel_cur = vel;
+}
+
+/* As servo_vel_calib_ok() */
+static int emu_vel_calib_ok(const struct servo_limits *l, unsigned int neutral_ns,
+                            unsigned int deadband_ns) {
+    unsigned int n = neutral_ns ? neutral_ns :
+                     l->min_pulse_ns + (l->max_pulse_ns - l->min_pulse_ns) / 2;
+    unsigned int room;
+
+    if (n <= l->min_pulse_ns || n >= l->max_pulse_ns)
+        return 0;
+    room = n - l->min_pulse_ns < l->max_pulse_ns - n ? n - l->min_pulse_ns : l->max_pulse_ns - n;
+    return deadband_ns < room;
+}
+
+/* Keep target and output inside new limits */
+static void emu_limits_changed(struct emu *e) {
+    const struct servo_limits *l = &e->limits;
+
+    if (e->target_angle < l->min_angle) e->target_angle = l->min_angle;
+    if (e->target_angle > l->max_angle) e->target_angle = l->max_angle;
+    if (!emu_vel_calib_ok(l, e->vel_neutral_ns, e->vel_deadband_ns)) {
+        e->vel_neutral_ns = 0;
+        e->vel_deadband_ns = 0;
+    }
+    if (e->vel_mode) {
+        emu_apply_velocity(e, e->vel_cur);
+    } else if (e->raw_pulse_ns) {
+        emu_set_pulse(e, e->raw_pulse_ns);
+    } else if (e->enabled) {
+        int cur = e->cur_angle < l->min_angle ? l->min_angle :
+                  e->cur_angle > l->max_angle ? l->max_angle : e->cur_angle;
+        emu_apply_mdeg(e, cur * 1000);
+    }
+}
+
+/* The tick in effect: tick_us rounded to whole frames, as servo_tick_ns() */
+static int64_t emu_tick_ns(const struct emu *e) {
+    int64_t frames = ((int64_t)e->tick_us * 1000 + e->period_ns / 2) / e->period_ns;
+
+    return (frames > 0 ? frames : 1) * e->period_ns;
+}
+
+/* SET_PROTOCOL/SET_TIMING period, 0 keeps it */
+static int emu_set_period(struct emu *e, unsigned int period_ns) {
+    if (!period_ns)
+        return 0;
+    if (period_ns > EMU_MAX_PERIOD_NS || period_ns <= e->limits.max_pulse_ns)
+        return -EINVAL;
+    e->period_ns = period_ns;
+    emu_limits_changed(e);
+    return 0;
+}
+
+static void emu_set_enabled(struct emu *e, int val) {
+    if (val && !e->enabled) {
+        e->estop = 0;
+        e->enabled = 1;
+        if (e->vel_mode)
+            emu_apply_velocity(e, 0);
+        else if (e->raw_pulse_ns)
+            emu_apply_raw(e, e->raw_pulse_ns);
+        else
+            emu_apply_mdeg(e, e->cur_angle * 1000);
+    } else if (!val && e->enabled) {
+        e->enabled = 0;
+        e->vel_cur = 0;
+        emu_pwm(e, 0, e->duty_ns);
+    }
+}
+
+static void emu_estop(struct emu *e) {
+    e->estop = 1;
+    e->enabled = 0;
+    emu_pwm(e, 0, e->duty_ns);
+    e->target_angle = e->cur_angle;
+    e->timed_count = 0;
+    e->traj_active = 0;
+    e->traj_count = 0;
+    e->stream_moving = 0;
+    e->stage.mask = 0;
+    e->committed = 0;
+    e->vel_target = 0;
+    e->vel_cur = 0;
+}
+
+/* As servo_set_rotation() */
+static int emu_set_rotation(struct emu *e, const struct servo_rotation *r) {
+    if (r->mode > SERVO_MODE_VELOCITY || r->ramp_pmps > EMU_VEL_MAX_RAMP)
+        return -EINVAL;
+    if (!emu_vel_calib_ok(&e->limits, r->neutral_ns, r->deadband_ns))
+        return -EINVAL;
+
+    e->vel_neutral_ns = r->neutral_ns;
+    e->vel_deadband_ns = r->deadband_ns;
+    e->vel_ramp = r->ramp_pmps;
+
+    if (r->mode == SERVO_MODE_VELOCITY && !e->vel_mode) {
+        emu_set_target(e, e->cur_angle);
+        e->stream_moving = 0;
+        e->vel_target = 0;
+        e->vel_mode = 1;
+        emu_apply_velocity(e, 0);
+    } else if (r->mode == SERVO_MODE_POSITION && e->vel_mode) {
+        e->vel_mode = 0;
+        e->vel_target = 0;
+        e->vel_cur = 0;
+        emu_apply_mdeg(e, e->cur_angle * 1000);
+    } else if (e->vel_mode) {
+        emu_apply_velocity(e, e->vel_cur);
+    }
+    return 0;
+}
+
+static void emu_stream_setpoint(struct emu *e, int64_t now) {
+    int64_t interval = now - e->stream_t0;
+
+    if (e->stream_t0 && interval <= EMU_STREAM_MAX_NS)
+        e->stream_dur_ns = (3 * e->stream_dur_ns + interval) / 4;
+    e->stream_from = e->cur_mdeg;
+    e->stream_to = e->target_angle * 1000;
+    e->stream_t0 = now;
+    e->stream_moving = 1;
+}
+
+static const struct servo_knot *emu_knot(struct emu *e, unsigned int i) {
+    return &e->traj[(e->traj_head + i) % EMU_TRAJ_MAX_KNOTS];
+}
+
+static int64_t emu_tangent(struct emu *e, unsigned int i) {
+    return servo_core_tangent(i ? emu_knot(e, i - 1) : NULL, emu_knot(e, i),
+                              i + 1 < e->traj_count ? emu_knot(e, i + 1) : NULL);
+}
+
+/* Same walk as servo_traj_step() */
+static void emu_traj_step(struct emu *e, int64_t now) {
+    int64_t t_us = (now - e->traj_start) / 1000;
+    int lo = e->limits.min_angle * 1000, hi = e->limits.max_angle * 1000, mdeg;
+    const struct servo_knot *last;
+    unsigned int i;
+
+    if (t_us < 0)
+        return;
+
+    while (e->traj_count >= 3 && t_us >= (int64_t)emu_knot(e, 2)->t_ms * 1000) {
+        e->traj_head = (e->traj_head + 1) % EMU_TRAJ_MAX_KNOTS;
+        e->traj_count--;
+    }
+
+    last = emu_knot(e, e->traj_count - 1);
+    if (e->traj_count < 2 || t_us >= (int64_t)last->t_ms * 1000) {
+        emu_apply_mdeg(e, last->angle_mdeg < lo ? lo : last->angle_mdeg > hi ? hi : last->angle_mdeg);
+        e->traj_active = 0;
+        emu_event(e, SERVO_EV_TRAJ_UNDERRUN);
+        return;
+    }
+
+    i = t_us >= (int64_t)emu_knot(e, 1)->t_ms * 1000 ? 1 : 0;
+    mdeg = servo_core_hermite(emu_knot(e, i), emu_knot(e, i + 1),
+                              emu_tangent(e, i), emu_tangent(e, i + 1), t_us);
+    emu_apply_mdeg(e, mdeg < lo ? lo : mdeg > hi ? hi : mdeg);
+}
+
+static int emu_traj_load(struct emu *e, const struct servo_traj *tr, const struct servo_knot *k) {
+    int append = tr->flags & SERVO_TRAJ_APPEND;
+    unsigned int i, n, first = 0;
+
+    if (append && !e->traj_count)
+        return -EINVAL;
+    for (i = 0; i < tr->count; i++) {
+        if ((k[i].flags & ~SERVO_KNOT_VEL) || abs(k[i].vel_mdps) > EMU_TRAJ_MAX_VEL)
+            return -EINVAL;
+        if (i && k[i].t_ms <= k[i - 1].t_ms)
+            return -EINVAL;
+    }
+    if (append) {
+        if (k[0].t_ms <= emu_knot(e, e->traj_count - 1)->t_ms)
+            return -EINVAL;
+    } else if (k[0].t_ms > 0) {
+        first = 1;
+    }
+
+    n = append ? e->traj_count : 0;
+    if (n + first + tr->count > EMU_TRAJ_MAX_KNOTS)
+        return -ENOSPC;
+
+    if (!append) {
+        e->traj_head = 0;
+        e->traj_count = 0;
+        e->traj_start = tr->start_ns ? tr->start_ns : now_ns();
+        if (first) {
+            e->traj[0] = (struct servo_knot){ .angle_mdeg = e->cur_mdeg, .flags = SERVO_KNOT_VEL };
+            e->traj_count = 1;
+        }
+    }
+    for (i = 0; i < tr->count; i++)
+        e->traj[(e->traj_head + e->traj_count++) % EMU_TRAJ_MAX_KNOTS] = k[i];
+
+    e->target_angle = (k[tr->count - 1].angle_mdeg + 500) / 1000;
+    if (e->target_angle < e->limits.min_angle) e->target_angle = e->limits.min_angle;
+    if (e->target_angle > e->limits.max_angle) e->target_angle = e->limits.max_angle;
+    e->traj_active = 1;
+    return 0;
+}
+
+static int emu_timed_queue(struct emu *e, int enable, const struct servo_timed *t) {
+    unsigned int i;
+
+    if (e->timed_count == EMU_TIMED_DEPTH)
+        return -ENOSPC;
+    for (i = e->timed_count; i > 0 && e->timed[i - 1].deadline_ns > t->deadline_ns; i--)
+        e->timed[i] = e->timed[i - 1];
+    e->timed[i] = (struct emu_timed){ t->deadline_ns, enable, t->value };
+    e->timed_count++;
+    return 0;
+}
+
+/* Same checks as servo_stage_check() */
+static int emu_stage_check(const struct servo_stage *sg) {
+    if ((sg->mask & ~SERVO_STAGE_ALL) || sg->reserved)
+        return -EINVAL;
+    if ((sg->mask & SERVO_STAGE_ANGLE) && (sg->mask & SERVO_STAGE_PULSE))
+        return -EINVAL;
+    if ((sg->mask & SERVO_STAGE_LIMITS) &&
+        (sg->limits.max_angle <= sg->limits.min_angle ||
+         sg->limits.max_pulse_ns <= sg->limits.min_pulse_ns))
+        return -EINVAL;
+    return 0;
+}
+
+/* As servo_stage_fits(): what depends on the device's state */
+static int emu_stage_fits(const struct emu *e, const struct servo_stage *sg) {
+    if ((sg->mask & SERVO_STAGE_LIMITS) && sg->limits.max_pulse_ns >= e->period_ns)
+        return -EINVAL;
+    if ((sg->mask & (SERVO_STAGE_ANGLE | SERVO_STAGE_PULSE)) && e->vel_mode)
+        return -EBUSY;
+    return 0;
+}
+
+static void emu_stage_apply(struct emu *e, int64_t now) {
+    const struct servo_stage *sg = &e->stage;
+
+    if (!e->committed)
+        return;
+    e->committed = 0;
+
+    /* the period changed since STAGE: drop it */
+    if (emu_stage_fits(e, sg) == -EINVAL) {
+        e->stage.mask = 0;
+        emu_event(e, SERVO_EV_PWM_FAULT);
+        return;
+    }
+
+    if (sg->mask & SERVO_STAGE_SPEED)
+        e->speed_dps = sg->speed_dps < 0 ? 0 : sg->speed_dps;
+    if (sg->mask & SERVO_STAGE_LIMITS) {
+        e->limits = sg->limits;
+        emu_limits_changed(e);
+    }
+    /* switched to velocity mode since STAGE: the position part lapses */
+    if ((sg->mask & SERVO_STAGE_PULSE) && !e->vel_mode)
+        emu_set_pulse(e, sg->pulse_ns);
+    if ((sg->mask & SERVO_STAGE_ANGLE) && !e->vel_mode) {
+        emu_set_target(e, sg->angle);
+        if (e->stream_on)
+            emu_stream_setpoint(e, now);
+    }
+    e->stage.mask = 0;
+}
+
+static void emu_stage_add(struct emu *e, const struct servo_stage *sg) {
+    /* committed but not ticked yet: belongs to that commit */
+    emu_stage_apply(e, now_ns());
+
+    if (sg->mask & SERVO_STAGE_ANGLE) {
+        e->stage.angle = sg->angle;
+        e->stage.mask &= ~SERVO_STAGE_PULSE;
+    }
+    if (sg->mask & SERVO_STAGE_PULSE) {
+        e->stage.pulse_ns = sg->pulse_ns;
+        e->stage.mask &= ~SERVO_STAGE_ANGLE;
+    }
+    if (sg->mask & SERVO_STAGE_SPEED)
+        e->stage.speed_dps = sg->speed_dps;
+    if (sg->mask & SERVO_STAGE_LIMITS)
+        e->stage.limits = sg->limits;
+    e->stage.mask = sg->mask ? e->stage.mask | sg->mask : 0;
+}
+
+/* One control tick, as servo_motion_step() */
+static void emu_step(struct emu *e, int64_t now) {
+    unsigned int n = 0;
+    int setpoint = 0;
+
+    emu_stage_apply(e, now);
+
+    while (n < e->timed_count && e->timed[n].deadline_ns <= now) {
+        if (e->timed[n].enable) {
+            emu_set_enabled(e, e->timed[n].value);
+        } else {
+            emu_set_target(e, e->timed[n].value);
+            setpoint = 1;
+        }
+        n++;
+    }
+    e->timed_count -= n;
+    memmove(e->timed, e->timed + n, e->timed_count * sizeof(e->timed[0]));
+    /* a due SET_ANGLE_AT is a setpoint like SET_ANGLE */
+    if (setpoint && e->stream_on)
+        emu_stream_setpoint(e, now);
+
+    if (!e->enabled || e->estop)
+        return;
+
+    if (e->vel_mode) {
+        if (e->vel_cur != e->vel_target)
+            emu_apply_velocity(e, servo_core_step(e->vel_cur, e->vel_target,
+                               e->vel_ramp ? servo_core_step_deg_us(e->vel_ramp,
+                                                                    emu_tick_ns(e) / 1000)
+                                           : 2 * SERVO_VELOCITY_MAX));
+    } else if (e->traj_active) {
+        emu_traj_step(e, now);
+    } else if (e->stream_on) {
+        if (e->stream_moving) {
+            int held;
+            int64_t lo = (int64_t)e->limits.min_angle * 1000;
+            int64_t hi = (int64_t)e->limits.max_angle * 1000;
+            int64_t pos = servo_core_stream_pos(e->stream_from, e->stream_to, e->stream_dur_ns,
+                                                e->stream_horizon_ns, now - e->stream_t0, &held);
+            if (held)
+                e->stream_moving = 0;
+            emu_apply_mdeg(e, pos < lo ? lo : pos > hi ? hi : pos);
+        }
+    } else if (e->cur_angle != e->target_angle) {
+        int next = e->speed_dps == 0 ? e->target_angle :
+                   servo_core_step(e->cur_angle, e->target_angle,
+                                   servo_core_step_deg_us(e->speed_dps, emu_tick_ns(e) / 1000));
+        emu_apply_mdeg(e, next * 1000);
+        if (e->cur_angle == e->target_angle)
+            emu_event(e, SERVO_EV_TARGET_REACHED);
+    }
+}
+
+static void *emu_tick_thread(void *arg) {
+    struct emu *e = arg;
+    struct timespec next;
+    int64_t tick;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (;;) {
+        pthread_mutex_lock(&e->lock);
+        tick = emu_tick_ns(e);
+        pthread_mutex_unlock(&e->lock);
+        next.tv_sec += tick / 1000000000L;
+        next.tv_nsec += tick % 1000000000L;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            ;
+        pthread_mutex_lock(&e->lock);
+        emu_step(e, now_ns());
+        pthread_mutex_unlock(&e->lock);
+        fflush(stdout);
+    }
+    return NULL;
+}
+
+/* ---------- CUSE ---------- */
+
+static struct fuse_session *emu_ctl_se;    /* -c, see emu_ctl_open() */
+
+static void *emu_ctl_thread(void *arg) {
+    fuse_session_loop(arg);
+    return NULL;
+}
+
+static void emu_start(void *(*fn)(void *), void *arg) {
+    pthread_t tid;
+
+    if (pthread_create(&tid, NULL, fn, arg)) {
+        fprintf(stderr, "servocuse: cannot start thread\n");
+        exit(1);
+    }
+    pthread_detach(tid);
+}
+
+static void emu_init_done(void *userdata) {
+    /* after daemonizing: threads do not survive the fork */
+    emu_start(emu_tick_thread, userdata);
+    if (emu_ctl_se)
+        emu_start(emu_ctl_thread, emu_ctl_se);
+}
+
+static void emu_open(fuse_req_t req, struct fuse_file_info *fi) {
+    fuse_reply_open(req, fi);
+}
+
+/* As servo_get_state(). Called with emu.lock held. */
+static void emu_get_state(const struct emu *e, struct servo_state *st) {
+    *st = (struct servo_state){
+        .stamp_ns = now_ns(), .index = e->index,
+        .cur_angle = e->cur_angle, .target_angle = e->target_angle,
+        .cur_mdeg = e->cur_mdeg, .speed_dps = e->speed_dps,
+        .limits = e->limits, .pulse_ns = e->duty_ns,
+        .timed_depth = e->timed_count, .traj_depth = e->traj_count,
+        .ring_depth = 0,    /* no mmap ring under CUSE */
+        .velocity = e->vel_cur, .target_velocity = e->vel_target,
+    };
+    if (e->enabled)
+        st->flags |= SERVO_STATE_ENABLED;
+    if (e->estop)
+        st->flags |= SERVO_STATE_ESTOP;
+    if (e->traj_active)
+        st->flags |= SERVO_STATE_TRAJ;
+    if (e->stream_on)
+        st->flags |= SERVO_STATE_STREAM;
+    if (e->raw_pulse_ns)
+        st->flags |= SERVO_STATE_RAW;
+    if (e->vel_mode) {
+        st->flags |= SERVO_STATE_VELOCITY;
+        if (e->enabled && e->vel_cur)
+            st->flags |= SERVO_STATE_MOVING;
+    } else if (e->enabled && (e->traj_active || e->stream_moving ||
+                              (!e->stream_on && e->cur_angle != e->target_angle))) {
+        st->flags |= SERVO_STATE_MOVING;
+    }
+}
+
+/* Executes cmd with its input in in; fills out. Called with emu.lock held. */
+static int emu_do_ioctl(struct emu *e, unsigned int cmd, const void *in, void *out) {
+    int val;
+
+    switch (cmd) {
+    case SERVO_IOCTL_ENABLE:
+        memcpy(&val, in, sizeof(val));
+        emu_set_enabled(e, val);
+        return 0;
+
+    case SERVO_IOCTL_ESTOP:
+    case SERVO_IOCTL_ESTOP_ALL:
+        emu_estop(e);
+        return 0;
+
+    case SERVO_IOCTL_SET_ANGLE:
+        memcpy(&val, in, sizeof(val));
+        if (e->vel_mode)
+            return -EBUSY;
+        emu_set_target(e, val);
+        if (e->stream_on)
+            emu_stream_setpoint(e, now_ns());
+        return 0;
+
+    case SERVO_IOCTL_SET_ANGLE_AT:
+    case SERVO_IOCTL_ENABLE_AT: {
+        struct servo_timed t;
+        memcpy(&t, in, sizeof(t));
+        if (t.deadline_ns < 0 || t.reserved)
+            return -EINVAL;
+        if (cmd == SERVO_IOCTL_SET_ANGLE_AT && e->vel_mode)
+            return -EBUSY;
+        return emu_timed_queue(e, cmd == SERVO_IOCTL_ENABLE_AT, &t);
+    }
+
+    case SERVO_IOCTL_TRAJ_LOAD: {
+        struct servo_traj tr;
+        memcpy(&tr, in, sizeof(tr));
+        if (e->vel_mode)
+            return -EBUSY;
+        /* knots follow the header, fetched by the retry in emu_request() */
+        return emu_traj_load(e, &tr, (const struct servo_knot *)((const char *)in + sizeof(tr)));
+    }
+
+    case SERVO_IOCTL_TRAJ_STOP:
+        emu_set_target(e, e->cur_angle);
+        return 0;
+
+    case SERVO_IOCTL_SET_STREAM: {
+        struct servo_stream st;
+        memcpy(&st, in, sizeof(st));
+        if (st.enable > 1 || st.horizon_ms > EMU_STREAM_MAX_NS / 1000000)
+            return -EINVAL;
+        e->stream_horizon_ns = (int64_t)st.horizon_ms * 1000000;
+        e->stream_dur_ns = emu_tick_ns(e);
+        e->stream_t0 = 0;
+        e->stream_moving = 0;
+        e->stream_on = st.enable;
+        return 0;
+    }
+
+    case SERVO_IOCTL_SET_PULSE_NS: {
+        __u32 ns;
+        memcpy(&ns, in, sizeof(ns));
+        if (e->vel_mode)
+            return -EBUSY;
+        emu_set_pulse(e, ns);
+        return 0;
+    }
+
+    case SERVO_IOCTL_GET_PULSE_NS:
+        memcpy(out, &e->duty_ns, sizeof(__u32));
+        return 0;
+
+    case SERVO_IOCTL_GET_ANGLE:
+        memcpy(out, &e->cur_angle, sizeof(int));
+        return 0;
+
+    case SERVO_IOCTL_SET_SPEED:
+        memcpy(&val, in, sizeof(val));
+        e->speed_dps = val < 0 ? 0 : val;
+        return 0;
+
+    case SERVO_IOCTL_GET_SPEED:
+        memcpy(out, &e->speed_dps, sizeof(int));
+        return 0;
+
+    case SERVO_IOCTL_SET_LIMITS: {
+        struct servo_limits l;
+        memcpy(&l, in, sizeof(l));
+        if (l.max_angle <= l.min_angle || l.max_pulse_ns <= l.min_pulse_ns ||
+            l.max_pulse_ns >= e->period_ns)
+            return -EINVAL;
+        e->limits = l;
+        emu_limits_changed(e);
+        return 0;
+    }
+
+    case SERVO_IOCTL_GET_LIMITS:
+        memcpy(out, &e->limits, sizeof(e->limits));
+        return 0;
+
+    case SERVO_IOCTL_STAGE: {
+        struct servo_stage sg;
+        memcpy(&sg, in, sizeof(sg));
+        if (emu_stage_check(&sg))
+            return -EINVAL;
+        val = emu_stage_fits(e, &sg);
+        if (!val)
+            emu_stage_add(e, &sg);
+        return val;
+    }
+
+    case SERVO_IOCTL_GET_EVENTS:
+        memcpy(out, &e->ev_pending, sizeof(__u32));
+        e->ev_pending = 0;
+        return 0;
+
+    case SERVO_IOCTL_GET_PENDING: {
+        struct servo_pending p = { { 0 } };
+        if (e->ctl_pending)
+            p.ids[e->index / 64] |= 1ULL << (e->index % 64);
+        e->ctl_pending = 0;
+        memcpy(out, &p, sizeof(p));
+        return 0;
+    }
+
+    case SERVO_IOCTL_RING_KICK:
+        /* no ring to consume, see the top of the file */
+        return 0;
+
+    case SERVO_IOCTL_SET_ROTATION: {
+        struct servo_rotation r;
+        memcpy(&r, in, sizeof(r));
+        return emu_set_rotation(e, &r);
+    }
+
+    case SERVO_IOCTL_GET_ROTATION: {
+        struct servo_rotation r = {
+            e->vel_mode ? SERVO_MODE_VELOCITY : SERVO_MODE_POSITION,
+            e->vel_neutral_ns, e->vel_deadband_ns, e->vel_ramp,
+        };
+        memcpy(out, &r, sizeof(r));
+        return 0;
+    }
+
+    case SERVO_IOCTL_SET_VELOCITY:
+        memcpy(&val, in, sizeof(val));
+        if (!e->vel_mode)
+            return -EBUSY;
+        e->vel_target = val < -SERVO_VELOCITY_MAX ? -SERVO_VELOCITY_MAX :
+                        val > SERVO_VELOCITY_MAX ? SERVO_VELOCITY_MAX : val;
+        return 0;
+
+    case SERVO_IOCTL_GET_VELOCITY:
+        memcpy(out, &e->vel_cur, sizeof(int));
+        return 0;
+
+    case SERVO_IOCTL_SET_PROTOCOL: {
+        struct servo_protocol p;
+        memcpy(&p, in, sizeof(p));
+        if (p.protocol != SERVO_PROTO_STANDARD)
+            return -EOPNOTSUPP;
+        return emu_set_period(e, p.period_ns ? p.period_ns : EMU_PERIOD_NS);
+    }
+
+    case SERVO_IOCTL_GET_PROTOCOL: {
+        struct servo_protocol p = { SERVO_PROTO_STANDARD, e->period_ns };
+        memcpy(out, &p, sizeof(p));
+        return 0;
+    }
+
+    case SERVO_IOCTL_SET_TIMING: {
+        struct servo_timing t;
+        memcpy(&t, in, sizeof(t));
+        if (t.reserved ||
+            (t.tick_us && (t.tick_us < EMU_MIN_TICK_US || t.tick_us > EMU_MAX_TICK_US)))
+            return -EINVAL;
+        if (emu_set_period(e, t.period_ns))
+            return -EINVAL;
+        if (t.tick_us)
+            e->tick_us = t.tick_us;
+        return 0;
+    }
+
+    case SERVO_IOCTL_GET_TIMING: {
+        struct servo_timing t = { e->period_ns, e->tick_us, (__u32)emu_tick_ns(e), 0 };
+        memcpy(out, &t, sizeof(t));
+        return 0;
+    }
+
+    case SERVO_IOCTL_COMMIT:
+        e->committed = e->stage.mask != 0;
+        return 0;
+
+    case SERVO_IOCTL_GET_STATE: {
+        struct servo_state st;
+        emu_get_state(e, &st);
+        memcpy(out, &st, sizeof(st));
+        return 0;
+    }
+    }
+    return -ENOTTY;
+}
+
+/* The /dev/servo-ctl commands, as servo_ctl_ioctl(). Called with emu.lock held. */
+static int emu_ctl_do_ioctl(struct emu *e, unsigned int cmd, const void *in, void *out) {
+    switch (cmd) {
+    case SERVO_IOCTL_GET_STATES: {
+        struct servo_states req;
+        struct servo_state st;
+        memcpy(&req, in, sizeof(req));
+        /* the state array follows the header, see emu_request() */
+        if (req.count) {
+            emu_get_state(e, &st);
+            memcpy((char *)out + sizeof(req), &st, sizeof(st));
+            req.count = 1;
+        }
+        req.total = 1;
+        memcpy(out, &req, sizeof(req));
+        return 0;
+    }
+
+    case SERVO_IOCTL_STAGE_BATCH: {
+        struct servo_stage_batch b;
+        struct servo_stage sg;
+        unsigned int i;
+        int ret;
+
+        /* all or nothing, as servo_ctl_stage_batch(); the stages follow */
+        memcpy(&b, in, sizeof(b));
+        for (i = 0; i < b.count; i++) {
+            memcpy(&sg, (const char *)in + sizeof(b) + i * sizeof(sg), sizeof(sg));
+            if (emu_stage_check(&sg))
+                return -EINVAL;
+        }
+        for (i = 0; i < b.count; i++) {
+            memcpy(&sg, (const char *)in + sizeof(b) + i * sizeof(sg), sizeof(sg));
+            if (sg.index != e->index)
+                return -ENODEV;
+            ret = emu_stage_fits(e, &sg);
+            if (ret)
+                return ret;
+        }
+        for (i = 0; i < b.count; i++) {
+            memcpy(&sg, (const char *)in + sizeof(b) + i * sizeof(sg), sizeof(sg));
+            emu_stage_add(e, &sg);
+        }
+        if (b.flags & SERVO_BATCH_COMMIT)
+            e->committed = e->stage.mask != 0;
+        return 0;
+    }
+
+    case SERVO_IOCTL_GET_PENDING:
+    case SERVO_IOCTL_ESTOP_ALL:
+    case SERVO_IOCTL_COMMIT:
+        return emu_do_ioctl(e, cmd, in, out);
+    }
+    return -ENOTTY;
+}
+
+/*
+ * Our own copy of the caller's eventfd fd. CUSE passes no file
+ * descriptors, so it is taken out of the calling process with
+ * pidfd_getfd(), which needs ptrace access to it (-EPERM otherwise).
+ */
+static int emu_caller_eventfd(fuse_req_t req, int fd) {
+    char path[64], line[128];
+    int tgid = -1, pidfd, ret;
+    ssize_t n;
+    FILE *fp;
+
+    /* the request names the calling thread, pidfd_open() wants its process */
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)fuse_req_ctx(req)->pid);
+    fp = fopen(path, "r");
+    if (!fp)
+        return -ESRCH;
+    while (tgid < 0 && fgets(line, sizeof(line), fp))
+        if (sscanf(line, "Tgid: %d", &tgid) != 1)
+            tgid = -1;
+    fclose(fp);
+    if (tgid < 0)
+        return -ESRCH;
+
+    pidfd = syscall(SYS_pidfd_open, tgid, 0);
+    if (pidfd < 0)
+        return -errno;
+    ret = syscall(SYS_pidfd_getfd, pidfd, fd, 0);
+    if (ret < 0)
+        ret = -errno;
+    close(pidfd);
+    if (ret < 0)
+        return ret;
+
+    /* as eventfd_ctx_fdget(): any other file is -EINVAL */
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", ret);
+    n = readlink(path, line, sizeof(line) - 1);
+    if (n < 0 || (line[n] = '\0', strcmp(line, "anon_inode:[eventfd]"))) {
+        close(ret);
+        return -EINVAL;
+    }
+    return ret;
+}
+
+/* SET_EVENTFD; SERVO_EVENTFD_CONTROLLER belongs to /dev/servo-ctl */
+static int emu_set_eventfd(struct emu *e, fuse_req_t req, const void *in, int ctl) {
+    struct servo_eventfd ef;
+    int fd = -1, *slot = ctl ? &e->ctl_evfd : &e->evfd;
+    uint32_t *mask = ctl ? &e->ctl_ev_mask : &e->ev_mask;
+
+    memcpy(&ef, in, sizeof(ef));
+    if (ef.flags != (ctl ? SERVO_EVENTFD_CONTROLLER : 0) ||
+        (ef.mask & ~SERVO_EV_ALL) || ef.reserved)
+        return -EINVAL;
+    if (ef.fd >= 0) {
+        fd = emu_caller_eventfd(req, ef.fd);
+        if (fd < 0)
+            return fd;
+    }
+
+    pthread_mutex_lock(&e->lock);
+    ef.fd = *slot;
+    *slot = fd;
+    *mask = fd >= 0 ? ef.mask : 0;
+    pthread_mutex_unlock(&e->lock);
+    if (ef.fd >= 0)
+        close(ef.fd);
+    return 0;
+}
+
+/*
+ * Unrestricted ioctl: the kernel passes no data until we name the user
+ * buffers with a retry. The size comes from the command; TRAJ_LOAD,
+ * STAGE_BATCH and GET_STATES need a second round for the array behind
+ * their pointer. ctl: the request came in on /dev/servo-ctl.
+ */
+static void emu_request(fuse_req_t req, unsigned int cmd, void *arg, unsigned int flags,
+                        const void *in_buf, size_t in_bufsz, size_t out_bufsz, int ctl) {
+    int wr = _IOC_DIR(cmd) & _IOC_WRITE, rd = _IOC_DIR(cmd) & _IOC_READ;
+    size_t size = _IOC_SIZE(cmd), out_size = size;
+    /* largest reply: GET_STATES with its one state */
+    char out[sizeof(struct servo_states) + sizeof(struct servo_state)];
+    struct iovec iov[2];
+    int ret;
+
+    if (flags & FUSE_IOCTL_COMPAT) {
+        fuse_reply_err(req, ENOSYS);
+        return;
+    }
+    if (size > sizeof(out) && !wr) {
+        fuse_reply_err(req, ENOTTY);
+        return;
+    }
+
+    /* in and out in the same round: the next one would drop the input */
+    iov[0] = (struct iovec){ arg, size };
+    if ((wr && in_bufsz < size) || (rd && out_bufsz < size)) {
+        fuse_reply_ioctl_retry(req, wr ? iov : NULL, wr ? 1 : 0, rd ? iov : NULL, rd ? 1 : 0);
+        return;
+    }
+
+    if (cmd == SERVO_IOCTL_TRAJ_LOAD && !ctl) {
+        struct servo_traj tr;
+
+        memcpy(&tr, in_buf, sizeof(tr));
+        if (!tr.count || tr.count > EMU_TRAJ_MAX_KNOTS ||
+            (tr.flags & ~SERVO_TRAJ_APPEND) || tr.start_ns < 0) {
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+        if (in_bufsz < sizeof(tr) + tr.count * sizeof(struct servo_knot)) {
+            iov[1] = (struct iovec){ (void *)(uintptr_t)tr.knots,
+                                     tr.count * sizeof(struct servo_knot) };
+            fuse_reply_ioctl_retry(req, iov, 2, NULL, 0);
+            return;
+        }
+    }
+    if (cmd == SERVO_IOCTL_STAGE_BATCH && ctl) {
+        struct servo_stage_batch b;
+
+        memcpy(&b, in_buf, sizeof(b));
+        if (!b.count || b.count > EMU_MAX_BATCH || (b.flags & ~SERVO_BATCH_COMMIT)) {
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+        if (in_bufsz < sizeof(b) + b.count * sizeof(struct servo_stage)) {
+            iov[1] = (struct iovec){ (void *)(uintptr_t)b.stages,
+                                     b.count * sizeof(struct servo_stage) };
+            fuse_reply_ioctl_retry(req, iov, 2, NULL, 0);
+            return;
+        }
+    }
+    if (cmd == SERVO_IOCTL_GET_STATES && ctl) {
+        struct servo_states st;
+
+        /* one servo: at most one state behind the header */
+        memcpy(&st, in_buf, sizeof(st));
+        if (st.count) {
+            out_size += sizeof(struct servo_state);
+            if (out_bufsz < out_size) {
+                iov[1] = (struct iovec){ (void *)(uintptr_t)st.states,
+                                         sizeof(struct servo_state) };
+                fuse_reply_ioctl_retry(req, iov, 1, iov, 2);
+                return;
+            }
+        }
+    }
+
+    if (cmd == SERVO_IOCTL_SET_EVENTFD) {
+        ret = emu_set_eventfd(&emu, req, in_buf, ctl);
+    } else {
+        pthread_mutex_lock(&emu.lock);
+        ret = ctl ? emu_ctl_do_ioctl(&emu, cmd, in_buf, out)
+                  : emu_do_ioctl(&emu, cmd, in_buf, out);
+        pthread_mutex_unlock(&emu.lock);
+    }
+
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_ioctl(req, 0, rd ? out : NULL, rd ? out_size : 0);
+}
+
+static void emu_ioctl(fuse_req_t req, unsigned int cmd, void *arg, struct fuse_file_info *fi,
+                      unsigned int flags, const void *in_buf, size_t in_bufsz,
+                      size_t out_bufsz) {
+    (void)fi;
+    emu_request(req, cmd, arg, flags, in_buf, in_bufsz, out_bufsz, 0);
+}
+
+static void emu_ctl_ioctl(fuse_req_t req, unsigned int cmd, void *arg, struct fuse_file_info *fi,
+                          unsigned int flags, const void *in_buf, size_t in_bufsz,
+                          size_t out_bufsz) {
+    (void)fi;
+    emu_request(req, cmd, arg, flags, in_buf, in_bufsz, out_bufsz, 1);
+}
+
+static const struct cuse_lowlevel_ops emu_ops = {
+    .init_done = emu_init_done,
+    .open      = emu_open,
+    .ioctl     = emu_ioctl,
+};
+
+static const struct cuse_lowlevel_ops emu_ctl_ops = {
+    .open      = emu_open,
+    .ioctl     = emu_ctl_ioctl,
+};
+
+/*
+ * /dev/servo-ctl as a second CUSE device: what cuse_lowlevel_setup() does,
+ * without daemonizing or taking the signal handlers. Served by its own
+ * thread from emu_init_done().
+ */
+static struct fuse_session *emu_ctl_open(void) {
+    static const char *dev_info_argv[] = { "DEVNAME=" SERVO_CTL_NAME };
+    static const struct cuse_info ci = {
+        .dev_info_argc = 1,
+        .dev_info_argv = dev_info_argv,
+        .flags = CUSE_UNRESTRICTED_IOCTL,
+    };
+    char *argv[] = { "servocuse", NULL };
+    struct fuse_args args = FUSE_ARGS_INIT(1, argv);
+    struct fuse_session *se;
+    char mnt[32];
+    int fd;
+
+    se = cuse_lowlevel_new(&args, &ci, &emu_ctl_ops, &emu);
+    if (!se)
+        return NULL;
+    fd = open("/dev/cuse", O_RDWR);
+    if (fd < 0) {
+        perror("servocuse: /dev/cuse");
+        fuse_session_destroy(se);
+        return NULL;
+    }
+    snprintf(mnt, sizeof(mnt), "/dev/fd/%d", fd);
+    if (fuse_session_mount(se, mnt)) {
+        close(fd);
+        fuse_session_destroy(se);
+        return NULL;
+    }
+    return se;
+}
+
+/* ---------- main ---------- */
+
+struct emu_opts {
+    char         *name;
+    unsigned int  tick_ms;
+    int           verbose;
+    int           ctl;
+};
+
+#define EMU_OPT(t, p) { t, offsetof(struct emu_opts, p), 1 }
+
+static const struct fuse_opt emu_opt_spec[] = {
+    EMU_OPT("-n %s", name),
+    EMU_OPT("--name=%s", name),
+    EMU_OPT("-t %u", tick_ms),
+    EMU_OPT("--tick=%u", tick_ms),
+    { "-v", offsetof(struct emu_opts, verbose), 1 },
+    { "-c", offsetof(struct emu_opts, ctl), 1 },
+    { "--ctl", offsetof(struct emu_opts, ctl), 1 },
+    FUSE_OPT_END
+};
+
+int main(int argc, char **argv) {
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct emu_opts opts = { .tick_ms = 20 };
+    char devname[128];
+    const char *dev_info_argv[] = { devname };
+    struct cuse_info ci = {
+        .dev_info_argc = 1,
+        .dev_info_argv = dev_info_argv,
+        .flags = CUSE_UNRESTRICTED_IOCTL,
+    };
+    int ret;
+
+    if (fuse_opt_parse(&args, &opts, emu_opt_spec, NULL))
+        return 1;
+    if (!opts.tick_ms || opts.tick_ms > 1000) {
+        fprintf(stderr, "servocuse: tick must be 1..1000 ms\n");
+        return 2;
+    }
+    snprintf(devname, sizeof(devname), "DEVNAME=%s", opts.name ? opts.name : "servo0");
+    if (opts.name && sscanf(opts.name, "servo%u", &emu.index) != 1)
+        emu.index = 0;
+    if (emu.index >= SERVO_PENDING_WORDS * 64) {
+        fprintf(stderr, "servocuse: servoN needs N < %d\n", SERVO_PENDING_WORDS * 64);
+        return 2;
+    }
+    emu.tick_us = opts.tick_ms * 1000;
+    emu.verbose = opts.verbose;
+    if (opts.ctl) {
+        emu_ctl_se = emu_ctl_open();
+        if (!emu_ctl_se) {
+            fprintf(stderr, "servocuse: cannot create /dev/" SERVO_CTL_NAME "\n");
+            return 1;
+        }
+    }
+
+    ret = cuse_lowlevel_main(args.argc, args.argv, &ci, &emu_ops, &emu);
+    fuse_opt_free_args(&args);
+    free(opts.name);
+    return ret;
+}
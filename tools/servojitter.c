@@ -0,0 +1,369 @@
+/*
+ * servojitter: motion-tick jitter of the servo driver, in the spirit of
+ * cyclictest.
+ *
+ * Keeps N channels (/dev/servo0..N-1) in continuous motion and records the
+ * timestamp of every motion tick, either from the servo:servo_tick
+ * tracepoint or from the mock PWM chip's apply log (one apply per tick
+ * while moving). Reports tick interval and, with the tracepoint, lateness
+ * against the time the tick was queued for, plus a histogram of the
+ * interval error |interval - tick|. An optional stress command runs in
+ * the background for the duration of the measurement.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#include "servo_uapi.h"
+
+#define MAX_CH       256
+#define TRACEFS      "/sys/kernel/tracing"
+#define TRACEFS_OLD  "/sys/kernel/debug/tracing"
+#define MOCK_LOG     "/sys/kernel/debug/servo-mock-pwm/log"
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-n CHANNELS] [-D SECONDS] [-s trace|mock] [-t TICK_MS]\n"
+        "          [-v SPEED_DPS] [-b BUCKET_US] [-B BUCKETS] [-S STRESS_CMD]\n"
+        "  -n CHANNELS  move /dev/servo0..N-1 (default 1)\n"
+        "  -D SECONDS   measurement time (default 10)\n"
+        "  -s SOURCE    trace: servo:servo_tick tracepoint (default)\n"
+        "               mock:  servo-mock-pwm apply log\n"
+        "  -t TICK_MS   nominal tick period (default 20)\n"
+        "  -v SPEED     motion speed in deg/s (default 30)\n"
+        "  -b BUCKET_US histogram bucket width (default 100)\n"
+        "  -B BUCKETS   histogram buckets (default 20)\n"
+        "  -S CMD       run 'sh -c CMD' as load while measuring\n",
+        prog
+    );
+}
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_file(const char *path, const char *val) {
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    int ok = fd >= 0 && write(fd, val, strlen(val)) == (ssize_t)strlen(val);
+
+    if (!ok)
+        fprintf(stderr, "write %s failed: %s\n", path, strerror(errno));
+    if (fd >= 0)
+        close(fd);
+    return ok ? 0 : -1;
+}
+
+/* ---------- statistics ---------- */
+
+struct stat_acc {
+    uint64_t  n;
+    int64_t   min, max;
+    double    sum;
+};
+
+static void acc_add(struct stat_acc *a, int64_t v) {
+    if (!a->n || v < a->min) a->min = v;
+    if (!a->n || v > a->max) a->max = v;
+    a->sum += v;
+    a->n++;
+}
+
+static void acc_print(const char *name, const struct stat_acc *a) {
+    if (!a->n) {
+        printf("%-9s no samples\n", name);
+        return;
+    }
+    printf("%-9s n=%-8llu min %9.1f  avg %9.1f  max %9.1f us\n", name,
+           (unsigned long long)a->n, a->min / 1e3, a->sum / a->n / 1e3, a->max / 1e3);
+}
+
+struct jitter {
+    int64_t          tick_ns;
+    int64_t          last[MAX_CH];   /* previous tick per channel, 0 = none */
+    struct stat_acc  interval, late;
+    uint64_t        *hist;
+    int              buckets;
+    int64_t          bucket_ns;
+    uint64_t         overflow;
+};
+
+static void jitter_reset(struct jitter *j) {
+    memset(j->last, 0, sizeof(j->last));
+    memset(&j->interval, 0, sizeof(j->interval));
+    memset(&j->late, 0, sizeof(j->late));
+    memset(j->hist, 0, j->buckets * sizeof(*j->hist));
+    j->overflow = 0;
+}
+
+/* due_ns < 0: unknown (mock log), 0: first tick after a kick */
+static void tick_sample(struct jitter *j, unsigned int ch, int64_t now, int64_t due) {
+    int64_t err;
+
+    if (ch >= MAX_CH)
+        return;
+    if (due > 0)
+        acc_add(&j->late, now - due);
+    /* a kicked tick follows an idle gap, its interval means nothing */
+    if (j->last[ch] && due != 0) {
+        acc_add(&j->interval, now - j->last[ch]);
+        err = llabs(now - j->last[ch] - j->tick_ns);
+        if (err / j->bucket_ns < j->buckets)
+            j->hist[err / j->bucket_ns]++;
+        else
+            j->overflow++;
+    }
+    j->last[ch] = now;
+}
+
+/* ---------- sources ---------- */
+
+struct source {
+    int       trace_fd;      /* trace_pipe, or -1 for the mock log */
+    char      tracefs[64];
+    char      buf[65536];
+    size_t    len;
+    uint64_t  mock_seq;      /* next unread log entry */
+};
+
+static int trace_open(struct source *s) {
+    char path[128];
+
+    snprintf(s->tracefs, sizeof(s->tracefs), "%s", TRACEFS);
+    if (access(TRACEFS "/events", F_OK))
+        snprintf(s->tracefs, sizeof(s->tracefs), "%s", TRACEFS_OLD);
+
+    snprintf(path, sizeof(path), "%s/trace", s->tracefs);
+    if (write_file(path, ""))
+        return -1;
+    snprintf(path, sizeof(path), "%s/events/servo/servo_tick/enable", s->tracefs);
+    if (write_file(path, "1"))
+        return -1;
+    snprintf(path, sizeof(path), "%s/trace_pipe", s->tracefs);
+    s->trace_fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (s->trace_fd < 0) {
+        fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void trace_close(struct source *s) {
+    char path[128];
+
+    snprintf(path, sizeof(path), "%s/events/servo/servo_tick/enable", s->tracefs);
+    write_file(path, "0");
+    close(s->trace_fd);
+}
+
+/* Drain trace_pipe for up to wait_ms, feeding complete lines */
+static void trace_poll(struct source *s, struct jitter *j, int wait_ms) {
+    struct pollfd pfd = { .fd = s->trace_fd, .events = POLLIN };
+    char *line, *nl;
+    ssize_t n;
+
+    if (poll(&pfd, 1, wait_ms) <= 0)
+        return;
+    while ((n = read(s->trace_fd, s->buf + s->len, sizeof(s->buf) - 1 - s->len)) > 0) {
+        s->len += n;
+        s->buf[s->len] = '\0';
+
+        line = s->buf;
+        while ((nl = strchr(line, '\n'))) {
+            unsigned int id;
+            long long now, due;
+            char *p = strstr(line, "servo_tick: ");
+
+            *nl = '\0';
+            if (p && sscanf(p, "servo_tick: id=%u now=%lld due=%lld", &id, &now, &due) == 3)
+                tick_sample(j, id, now, due);
+            line = nl + 1;
+        }
+        s->len -= line - s->buf;
+        memmove(s->buf, line, s->len);
+        if (s->len == sizeof(s->buf) - 1)
+            s->len = 0;  /* no newline in a full buffer: drop it */
+    }
+}
+
+/* Read log entries newer than the last pass; ticks = enabled applies */
+static int mock_poll(struct source *s, struct jitter *j) {
+    unsigned long long seq, ts, duty, period;
+    unsigned int ch, en;
+    char line[160];
+    FILE *f = fopen(MOCK_LOG, "r");
+
+    if (!f) {
+        fprintf(stderr, "open " MOCK_LOG " failed: %s\n", strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%llu %llu %u %u %llu %llu", &seq, &ts, &ch, &en, &duty, &period) != 6)
+            continue;
+        if (seq < s->mock_seq)
+            continue;
+        if (seq > s->mock_seq && s->mock_seq) {
+            /* ring overran between passes: restart the intervals */
+            memset(j->last, 0, sizeof(j->last));
+        }
+        s->mock_seq = seq + 1;
+        if (en)
+            tick_sample(j, ch, ts, -1);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* ---------- load ---------- */
+
+static pid_t stress_start(const char *cmd) {
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        setsid();
+        execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+        _exit(127);
+    }
+    if (pid < 0)
+        perror("fork");
+    return pid;
+}
+
+static void stress_stop(pid_t pid) {
+    if (pid <= 0)
+        return;
+    kill(-pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+/* ---------- main ---------- */
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+int main(int argc, char **argv) {
+    static struct source src = { .trace_fd = -1 };
+    static struct jitter j;
+    const char *source = "trace", *stress = NULL;
+    int nch = 1, seconds = 10, tick_ms = 20, speed = 30, bucket_us = 100, en = 1, opt;
+    int fds[MAX_CH], target[MAX_CH], lo[MAX_CH], hi[MAX_CH];
+    uint64_t t_end;
+    pid_t load = -1;
+
+    j.buckets = 20;
+    while ((opt = getopt(argc, argv, "n:D:s:t:v:b:B:S:h")) != -1) {
+        switch (opt) {
+        case 'n': nch = atoi(optarg); break;
+        case 'D': seconds = atoi(optarg); break;
+        case 's': source = optarg; break;
+        case 't': tick_ms = atoi(optarg); break;
+        case 'v': speed = atoi(optarg); break;
+        case 'b': bucket_us = atoi(optarg); break;
+        case 'B': j.buckets = atoi(optarg); break;
+        case 'S': stress = optarg; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (nch < 1 || nch > MAX_CH || seconds < 1 || tick_ms < 1 || speed < 1 ||
+        bucket_us < 1 || j.buckets < 1 ||
+        (strcmp(source, "trace") && strcmp(source, "mock"))) {
+        usage(argv[0]);
+        return 2;
+    }
+    j.tick_ns = (int64_t)tick_ms * 1000000;
+    j.bucket_ns = (int64_t)bucket_us * 1000;
+    j.hist = calloc(j.buckets, sizeof(*j.hist));
+    if (!j.hist)
+        return 1;
+
+    for (int i = 0; i < nch; i++) {
+        struct servo_limits l;
+        char dev[32];
+
+        snprintf(dev, sizeof(dev), "/dev/servo%d", i);
+        fds[i] = open(dev, O_RDWR);
+        if (fds[i] < 0) {
+            fprintf(stderr, "open(%s) failed: %s\n", dev, strerror(errno));
+            return 1;
+        }
+        if (ioctl(fds[i], SERVO_IOCTL_GET_LIMITS, &l) < 0 ||
+            ioctl(fds[i], SERVO_IOCTL_ENABLE, &en) < 0 ||
+            ioctl(fds[i], SERVO_IOCTL_SET_SPEED, &speed) < 0) {
+            perror(dev);
+            return 1;
+        }
+        /* sweep the middle of the range; flip well before arriving */
+        lo[i] = l.min_angle + (l.max_angle - l.min_angle) / 6;
+        hi[i] = l.max_angle - (l.max_angle - l.min_angle) / 6;
+        target[i] = hi[i];
+        ioctl(fds[i], SERVO_IOCTL_SET_ANGLE, &target[i]);
+    }
+
+    /* the mock log keeps older applies: skip them */
+    if (!strcmp(source, "trace") ? trace_open(&src) : mock_poll(&src, &j))
+        return 1;
+    jitter_reset(&j);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    if (stress)
+        load = stress_start(stress);
+
+    printf("servojitter: %d channel(s), %s source, %d ms tick, %d s%s%s\n",
+           nch, source, tick_ms, seconds, stress ? ", load: " : "", stress ? stress : "");
+
+    t_end = mono_ns() + (uint64_t)seconds * 1000000000ULL;
+    while (!stop && mono_ns() < t_end) {
+        if (src.trace_fd >= 0) {
+            trace_poll(&src, &j, 50);
+        } else {
+            usleep(50000);
+            if (mock_poll(&src, &j) < 0)
+                break;
+        }
+
+        for (int i = 0; i < nch; i++) {
+            int cur;
+
+            if (ioctl(fds[i], SERVO_IOCTL_GET_ANGLE, &cur) < 0)
+                continue;
+            if (abs(target[i] - cur) <= (hi[i] - lo[i]) / 8) {
+                target[i] = target[i] == hi[i] ? lo[i] : hi[i];
+                ioctl(fds[i], SERVO_IOCTL_SET_ANGLE, &target[i]);
+            }
+        }
+    }
+
+    stress_stop(load);
+    if (src.trace_fd >= 0)
+        trace_close(&src);
+    for (int i = 0; i < nch; i++)
+        close(fds[i]);
+
+    acc_print("interval", &j.interval);
+    if (j.late.n)
+        acc_print("lateness", &j.late);
+
+    printf("\n|interval - %d ms| histogram:\n", tick_ms);
+    for (int b = 0; b < j.buckets; b++)
+        printf("%7d-%-7d us %10llu\n", b * bucket_us, (b + 1) * bucket_us,
+               (unsigned long long)j.hist[b]);
+    printf("   >= %-8d us %10llu\n", j.buckets * bucket_us, (unsigned long long)j.overflow);
+    return 0;
+}
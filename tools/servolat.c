@@ -0,0 +1,262 @@
+/*
+ * servolat: end-to-end command-to-pulse latency of the servo driver.
+ *
+ * Timestamps every SERVO_IOCTL_SET_ANGLE with CLOCK_MONOTONIC and matches
+ * it against the mock PWM chip's apply log (servo_mock_pwm.ko, debugfs
+ * servo-mock-pwm/log), whose ktime stamps use the same clock. Reports
+ *
+ *   first : SET_ANGLE -> first new duty on the channel
+ *   final : SET_ANGLE -> duty of the target angle (== first in jump mode)
+ *
+ * for jump mode (speed 0) and the speed-limited motion loop.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include "servo_motion.h"
+
+#define DEFAULT_DEV  "/dev/servo0"
+#define DEFAULT_LOG  "/sys/kernel/debug/servo-mock-pwm/log"
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-d DEV] [-c CHANNEL] [-l LOG] [-n ITER] [-s SPEED_DPS] [-a A,B]\n"
+        "  -d DEV      servo device (default " DEFAULT_DEV ")\n"
+        "  -c CHANNEL  mock PWM channel of DEV (default: number in DEV)\n"
+        "  -l LOG      mock PWM apply log (default " DEFAULT_LOG ")\n"
+        "  -n ITER     moves per mode (default 200)\n"
+        "  -s SPEED    speed of the motion-loop run in deg/s (default 360)\n"
+        "  -a A,B      angles to alternate between (default 60,120)\n",
+        prog
+    );
+}
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_ms(unsigned int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static int log_clear(const char *path) {
+    int fd = open(path, O_WRONLY);
+    if (fd < 0 || write(fd, "0", 1) != 1) {
+        fprintf(stderr, "clear %s failed: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/*
+ * Scan the log for channel ch at or after t0. Returns 0 and sets
+ * *first and *final (0 if not seen) to the stamps of the first duty other than
+ * old_duty and of the first duty equal to final_duty.
+ */
+static int log_scan(const char *path, unsigned int ch, uint64_t t0,
+                    unsigned long long old_duty, unsigned long long final_duty,
+                    uint64_t *first, uint64_t *final) {
+    unsigned long long seq, ts, duty, period;
+    unsigned int c, en;
+    char line[160];
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    *first = *final = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%llu %llu %u %u %llu %llu", &seq, &ts, &c, &en, &duty, &period) != 6)
+            continue;
+        if (c != ch || !en || ts < t0)
+            continue;
+        if (!*first && duty != old_duty)
+            *first = ts;
+        if (duty == final_duty) {
+            *final = ts;
+            break;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, uint64_t *lat, int n) {
+    double sum = 0;
+
+    if (!n) {
+        printf("  %-6s no samples\n", name);
+        return;
+    }
+    qsort(lat, n, sizeof(*lat), cmp_u64);
+    for (int i = 0; i < n; i++)
+        sum += lat[i];
+    printf("  %-6s n=%-5d min %9.1f  avg %9.1f  p50 %9.1f  p99 %9.1f  max %9.1f us\n",
+           name, n, lat[0] / 1e3, sum / n / 1e3, lat[n / 2] / 1e3,
+           lat[(int)(0.99 * (n - 1))] / 1e3, lat[n - 1] / 1e3);
+}
+
+struct run {
+    int                  fd;
+    unsigned int         ch;
+    const char          *log;
+    int                  iter;
+    int                  a, b;
+    struct servo_limits  lims;
+};
+
+/* Wait for the servo to sit at angle; returns its duty or 0 on timeout */
+static unsigned long long settle(const struct run *r, int angle, unsigned int wait_ms) {
+    unsigned long long duty = servo_core_pulse_ns(&r->lims, (__s64)angle * 1000);
+    int cur;
+
+    for (unsigned int t = 0; t < wait_ms; t += 10) {
+        if (ioctl(r->fd, SERVO_IOCTL_GET_ANGLE, &cur) == 0 && cur == angle)
+            return duty;
+        sleep_ms(10);
+    }
+    return 0;
+}
+
+static int run_mode(const struct run *r, const char *name, int speed) {
+    uint64_t *first = calloc(r->iter, sizeof(*first));
+    uint64_t *final = calloc(r->iter, sizeof(*final));
+    int nfirst = 0, nfinal = 0, missed = 0, ret = -1;
+    unsigned int move_ms = 200;
+    unsigned long long old_duty;
+
+    if (!first || !final)
+        goto out;
+    if (ioctl(r->fd, SERVO_IOCTL_SET_SPEED, &speed) < 0) {
+        perror("SET_SPEED");
+        goto out;
+    }
+    if (speed > 0)
+        move_ms += (unsigned int)(abs(r->b - r->a) * 1000 / speed);
+
+    /* start from a known position */
+    if (ioctl(r->fd, SERVO_IOCTL_SET_ANGLE, &r->a) < 0) {
+        perror("SET_ANGLE");
+        goto out;
+    }
+    old_duty = settle(r, r->a, 10 * move_ms);
+
+    for (int i = 0; i < r->iter; i++) {
+        int angle = (i & 1) ? r->a : r->b;
+        unsigned long long duty = servo_core_pulse_ns(&r->lims, (__s64)angle * 1000);
+        uint64_t t0, tf, tl;
+
+        if (log_clear(r->log) < 0)
+            goto out;
+        t0 = mono_ns();
+        if (ioctl(r->fd, SERVO_IOCTL_SET_ANGLE, &angle) < 0) {
+            perror("SET_ANGLE");
+            goto out;
+        }
+        if (!settle(r, angle, 10 * move_ms)) {
+            missed++;
+            continue;
+        }
+        if (log_scan(r->log, r->ch, t0, old_duty, duty, &tf, &tl) < 0)
+            goto out;
+        if (tf)
+            first[nfirst++] = tf - t0;
+        if (tl)
+            final[nfinal++] = tl - t0;
+        else
+            missed++;
+        old_duty = duty;
+    }
+
+    printf("%s (speed %d dps, %d <-> %d deg):\n", name, speed, r->a, r->b);
+    report("first", first, nfirst);
+    report("final", final, nfinal);
+    if (missed)
+        printf("  %d move(s) not found in the log (ring overrun or wrong -c?)\n", missed);
+    ret = 0;
+out:
+    free(first);
+    free(final);
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    const char *dev = DEFAULT_DEV;
+    struct run r = { .log = DEFAULT_LOG, .iter = 200, .a = 60, .b = 120 };
+    int speed = 360, ch = -1, en = 1, opt;
+
+    while ((opt = getopt(argc, argv, "d:c:l:n:s:a:h")) != -1) {
+        switch (opt) {
+        case 'd': dev = optarg; break;
+        case 'c': ch = atoi(optarg); break;
+        case 'l': r.log = optarg; break;
+        case 'n': r.iter = atoi(optarg); break;
+        case 's': speed = atoi(optarg); break;
+        case 'a':
+            if (sscanf(optarg, "%d,%d", &r.a, &r.b) != 2) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (r.iter < 1 || speed < 1 || r.a == r.b) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (ch < 0) {
+        /* /dev/servoN <-> mock channel N when loaded with servo_mock_pwm */
+        const char *p = dev + strlen(dev);
+        while (p > dev && isdigit((unsigned char)p[-1]))
+            p--;
+        ch = *p ? atoi(p) : 0;
+    }
+    r.ch = ch;
+
+    r.fd = open(dev, O_RDWR);
+    if (r.fd < 0) {
+        fprintf(stderr, "open(%s) failed: %s\n", dev, strerror(errno));
+        return 1;
+    }
+    if (ioctl(r.fd, SERVO_IOCTL_GET_LIMITS, &r.lims) < 0 ||
+        ioctl(r.fd, SERVO_IOCTL_ENABLE, &en) < 0) {
+        perror("setup");
+        return 1;
+    }
+    if (r.a < r.lims.min_angle || r.a > r.lims.max_angle ||
+        r.b < r.lims.min_angle || r.b > r.lims.max_angle) {
+        fprintf(stderr, "angles outside limits %d..%d\n", r.lims.min_angle, r.lims.max_angle);
+        return 2;
+    }
+
+    printf("servolat: %s, channel %u, %d moves per mode\n", dev, r.ch, r.iter);
+    if (run_mode(&r, "jump", 0) < 0 || run_mode(&r, "motion loop", speed) < 0)
+        return 1;
+
+    close(r.fd);
+    return 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * servosim: offline simulation of the servo motion core (servo_motion.h),
+ * the same fixed-point code the kernel module runs in its motion tick.
+ *
+ *   servosim fuzz   [-i N] [-s SEED]   randomized invariant checks
+ *   servosim bench  [-n N] [-t MS]     moves/s and ticks/s of the planner
+ *   servosim replay [-t MS]            knots on stdin -> positions per tick
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+
+#include "servo_motion.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s fuzz   [-i ITER] [-s SEED]   check mapping/stepping/spline invariants\n"
+        "  %s bench  [-n MOVES] [-t TICK_MS]\n"
+        "  %s replay [-t TICK_MS]          read 't_ms angle_deg [vel_dps]' lines from stdin,\n"
+        "                                  print 't_ms angle_mdeg pulse_ns' per tick\n",
+        prog, prog, prog
+    );
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rnd(void) {
+    /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+/* uniform in [lo, hi] */
+static int64_t rnd_range(int64_t lo, int64_t hi) {
+    return lo + (int64_t)(rnd() % (uint64_t)(hi - lo + 1));
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void random_limits(struct servo_limits *L) {
+    /* mix realistic and extreme ranges */
+    if (rnd() & 1) {
+        L->min_angle = (int)rnd_range(-360, 0);
+        L->max_angle = (int)rnd_range(L->min_angle + 1, 720);
+        L->min_pulse_ns = (unsigned int)rnd_range(0, 2000000);
+        L->max_pulse_ns = (unsigned int)rnd_range(L->min_pulse_ns + 1, 25000000);
+    } else {
+        L->min_angle = (int)rnd_range(INT_MIN, INT_MAX - 1);
+        L->max_angle = (int)rnd_range((int64_t)L->min_angle + 1, INT_MAX);
+        L->min_pulse_ns = (unsigned int)rnd_range(0, UINT_MAX - 1);
+        L->max_pulse_ns = (unsigned int)rnd_range((int64_t)L->min_pulse_ns + 1, UINT_MAX);
+    }
+}
+
+static int fails;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        if (fails++ < 10) { fprintf(stderr, "FAIL %s: ", #cond); fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } \
+    } \
+} while (0)
+
+static void fuzz_pulse(void) {
+    struct servo_limits L;
+    int64_t lo, hi, a, b;
+    unsigned int pa, pb;
+
+    random_limits(&L);
+    lo = (int64_t)L.min_angle * 1000;
+    hi = (int64_t)L.max_angle * 1000;
+
+    CHECK(servo_core_pulse_ns(&L, lo) == L.min_pulse_ns, "lo end %d", L.min_angle);
+    CHECK(servo_core_pulse_ns(&L, hi) == L.max_pulse_ns, "hi end %d", L.max_angle);
+
+    a = rnd_range(lo - 5000, hi + 5000);
+    b = rnd_range(a, hi + 5000);
+    pa = servo_core_pulse_ns(&L, a);
+    pb = servo_core_pulse_ns(&L, b);
+    CHECK(pa >= L.min_pulse_ns && pa <= L.max_pulse_ns, "range %lld -> %u", (long long)a, pa);
+    CHECK(pa <= pb, "monotonic %lld -> %u, %lld -> %u", (long long)a, pa, (long long)b, pb);
+
+#ifdef __SIZEOF_INT128__
+    /* exact reference; without __int128 the checks above have to do */
+    {
+        int64_t ca = a < lo ? lo : a > hi ? hi : a;
+        unsigned __int128 ref = (unsigned __int128)(L.max_pulse_ns - L.min_pulse_ns) *
+                                (uint64_t)(ca - lo) / (uint64_t)(hi - lo);
+
+        CHECK(pa == L.min_pulse_ns + (unsigned int)ref, "reference %lld -> %u", (long long)a, pa);
+    }
+#endif
+}
+
+static void fuzz_step(void) {
+    int cur = (int)rnd_range(-1000, 1000);
+    int target = (int)rnd_range(-1000, 1000);
+    int speed = (int)rnd_range(0, 5000);
+    unsigned int tick = (unsigned int)rnd_range(1, 100);
+    int step = servo_core_step_deg(speed, tick);
+    int dist = abs(target - cur), n = 0, prev_dist;
+
+    CHECK(step >= 1, "step %d for %d dps / %u ms", step, speed, tick);
+    while (cur != target && n <= 3000) {
+        prev_dist = abs(target - cur);
+        cur = servo_core_step(cur, target, step);
+        CHECK(abs(target - cur) < prev_dist, "no progress at %d", cur);
+        CHECK(prev_dist - abs(target - cur) <= step, "step too large at %d", cur);
+        n++;
+    }
+    CHECK(n == (dist + step - 1) / step, "%d ticks for %d deg at %d/tick", n, dist, step);
+}
+
+static void fuzz_hermite(void) {
+    struct servo_knot k0 = { 0 }, k1 = { 0 };
+    int64_t m0, m1, t;
+    int p, lo, hi;
+
+    k0.t_ms = (uint32_t)rnd_range(0, 1000000);
+    k1.t_ms = k0.t_ms + (uint32_t)rnd_range(1, 100000);
+    k0.angle_mdeg = (int32_t)rnd_range(-1000000, 1000000);
+    k1.angle_mdeg = (int32_t)rnd_range(-1000000, 1000000);
+    m0 = rnd_range(-100000000, 100000000);
+    m1 = rnd_range(-100000000, 100000000);
+
+    /* knots are hit exactly */
+    CHECK(servo_core_hermite(&k0, &k1, m0, m1, (int64_t)k0.t_ms * 1000) == k0.angle_mdeg, "p0");
+    CHECK(servo_core_hermite(&k0, &k1, m0, m1, (int64_t)k1.t_ms * 1000) == k1.angle_mdeg, "p1");
+
+    /* zero tangents: no overshoot */
+    lo = k0.angle_mdeg < k1.angle_mdeg ? k0.angle_mdeg : k1.angle_mdeg;
+    hi = k0.angle_mdeg < k1.angle_mdeg ? k1.angle_mdeg : k0.angle_mdeg;
+    t = rnd_range((int64_t)k0.t_ms * 1000, (int64_t)k1.t_ms * 1000);
+    p = servo_core_hermite(&k0, &k1, 0, 0, t);
+    CHECK(p >= lo - 1 && p <= hi + 1, "overshoot %d not in [%d, %d]", p, lo, hi);
+}
+
+static void fuzz_stream(void) {
+    int from = (int)rnd_range(-180000, 180000);
+    int to = (int)rnd_range(-180000, 180000);
+    int64_t dur = rnd_range(1, 1000000000);
+    int64_t hor = rnd_range(0, 1000000000);
+    int held;
+
+    CHECK(servo_core_stream_pos(from, to, dur, hor, 0, &held) == from && !held, "start");
+    CHECK(servo_core_stream_pos(from, to, dur, hor, dur, &held) == to, "end");
+    servo_core_stream_pos(from, to, dur, hor, dur + hor, &held);
+    CHECK(held, "held after horizon");
+}
+
+static int cmd_fuzz(long iters) {
+    double t0 = now_s();
+
+    for (long i = 0; i < iters; i++) {
+        fuzz_pulse();
+        fuzz_step();
+        fuzz_hermite();
+        fuzz_stream();
+    }
+    printf("fuzz: %ld iterations, %d failures (%.2f s)\n", iters, fails, now_s() - t0);
+    return fails ? 1 : 0;
+}
+
+static int cmd_bench(long moves, unsigned int tick_ms) {
+    struct servo_limits L = { 0, 180, 1000000, 2000000 };
+    struct servo_knot k0 = { 0 }, k1 = { 0 };
+    unsigned long long ticks = 0, sink = 0;
+    double t0, el;
+    long i;
+
+    t0 = now_s();
+    for (i = 0; i < moves; i++) {
+        int cur = (int)rnd_range(0, 180), target = (int)rnd_range(0, 180);
+        int step = servo_core_step_deg((int)rnd_range(1, 720), tick_ms);
+
+        while (cur != target) {
+            cur = servo_core_step(cur, target, step);
+            sink += servo_core_pulse_ns(&L, (int64_t)cur * 1000);
+            ticks++;
+        }
+    }
+    el = now_s() - t0;
+    printf("step:    %ld moves, %llu ticks in %.3f s -> %.0f moves/s, %.1f Mticks/s\n",
+           moves, ticks, el, moves / el, ticks / el / 1e6);
+
+    k1.t_ms = 1000;
+    k1.angle_mdeg = 180000;
+    t0 = now_s();
+    for (i = 0; i < moves * 50; i++)
+        sink += servo_core_hermite(&k0, &k1, 0, 90000, (i % 1000000));
+    el = now_s() - t0;
+    printf("hermite: %ld evaluations in %.3f s -> %.1f M/s\n", moves * 50, el, moves * 50 / el / 1e6);
+
+    return sink == 42; /* keep the work observable */
+}
+
+#define REPLAY_MAX 65536
+
+static int cmd_replay(unsigned int tick_ms) {
+    static struct servo_knot k[REPLAY_MAX];
+    struct servo_limits L = { 0, 180, 1000000, 2000000 };
+    unsigned int n = 0, i = 0;
+    double t, a, v;
+    char line[256];
+    int f;
+
+    while (fgets(line, sizeof(line), stdin) && n < REPLAY_MAX) {
+        if (line[0] == '#')
+            continue;
+        f = sscanf(line, "%lf %lf %lf", &t, &a, &v);
+        if (f < 2)
+            continue;
+        k[n].t_ms = (uint32_t)t;
+        k[n].angle_mdeg = (int32_t)(a * 1000);
+        k[n].vel_mdps = f == 3 ? (int32_t)(v * 1000) : 0;
+        k[n].flags = f == 3 ? SERVO_KNOT_VEL : 0;
+        if (n && k[n].t_ms <= k[n - 1].t_ms) {
+            fprintf(stderr, "knot %u: time must increase\n", n);
+            return 2;
+        }
+        n++;
+    }
+    if (n < 2) {
+        fprintf(stderr, "need at least two knots\n");
+        return 2;
+    }
+
+    for (uint64_t t_us = (uint64_t)k[0].t_ms * 1000; t_us <= (uint64_t)k[n - 1].t_ms * 1000;
+         t_us += tick_ms * 1000ULL) {
+        while (i + 2 < n && t_us >= (uint64_t)k[i + 1].t_ms * 1000)
+            i++;
+        int mdeg = servo_core_hermite(&k[i], &k[i + 1],
+                                      servo_core_tangent(i ? &k[i - 1] : NULL, &k[i], &k[i + 1]),
+                                      servo_core_tangent(&k[i], &k[i + 1], i + 2 < n ? &k[i + 2] : NULL),
+                                      (int64_t)t_us);
+        printf("%llu %d %u\n", (unsigned long long)(t_us / 1000), mdeg,
+               servo_core_pulse_ns(&L, mdeg));
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long iters = 1000000, moves = 1000000;
+    unsigned int tick_ms = 20;
+    const char *cmd;
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    cmd = argv[1];
+
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            iters = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            rng_state = strtoull(argv[++i], NULL, 0) | 1;
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            moves = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            tick_ms = (unsigned int)atoi(argv[++i]);
+            if (tick_ms < 1) tick_ms = 1;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!strcmp(cmd, "fuzz"))
+        return cmd_fuzz(iters);
+    if (!strcmp(cmd, "bench"))
+        return cmd_bench(moves, tick_ms);
+    if (!strcmp(cmd, "replay"))
+        return cmd_replay(tick_ms);
+
+    usage(argv[0]);
+    return 2;
+}